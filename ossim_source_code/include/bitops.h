@@ -1,3 +1,6 @@
+#ifndef BITOPS_H
+#define BITOPS_H
+
 #ifdef CONFIG_64BIT
 #define BITS_PER_LONG 64
 #else
@@ -35,3 +38,42 @@
 #define NBITS(n) (n==0?0:NBITS32(n))
 
 #define EXTRACT_NBITS(nr, h, l) ((nr&GENMASK(h,l)) >> l)
+
+/*
+ * Bitmaps are arrays of unsigned long, indexed independently of
+ * BITS_PER_LONG (which only sizes the GENMASK arithmetic above).
+ */
+#define BITS_PER_ULONG          (BITS_PER_BYTE * sizeof(unsigned long))
+#define BITMAP_WORD(nr)         ((nr) / BITS_PER_ULONG)
+#define BITMAP_MASK(nr)         (1UL << ((nr) % BITS_PER_ULONG))
+#define DECLARE_BITMAP(name, bits) unsigned long name[BITS_TO_LONGS(bits)]
+
+static inline void set_bit(int nr, unsigned long *addr)
+{
+	addr[BITMAP_WORD(nr)] |= BITMAP_MASK(nr);
+}
+
+static inline void clear_bit(int nr, unsigned long *addr)
+{
+	addr[BITMAP_WORD(nr)] &= ~BITMAP_MASK(nr);
+}
+
+static inline int test_bit(int nr, const unsigned long *addr)
+{
+	return (addr[BITMAP_WORD(nr)] & BITMAP_MASK(nr)) != 0;
+}
+
+/* Index of the lowest set bit in [addr], or [size] if none is set */
+static inline int find_first_bit(const unsigned long *addr, int size)
+{
+	int word;
+	for (word = 0; word * (int)BITS_PER_ULONG < size; word++) {
+		if (addr[word]) {
+			int nr = word * BITS_PER_ULONG + __builtin_ctzl(addr[word]);
+			return nr < size ? nr : size;
+		}
+	}
+	return size;
+}
+
+#endif /* BITOPS_H */
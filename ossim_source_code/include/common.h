@@ -4,6 +4,7 @@
 /* Define structs and routine could be used by every source files */
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef OSCFG_H
 #include "os-cfg.h"
@@ -13,6 +14,8 @@
 #include "os-mm.h"
 #endif
 
+#include "rbtree.h"
+
 #define ADDRESS_SIZE	20
 #define OFFSET_LEN	10
 #define FIRST_LV_LEN	5
@@ -31,7 +34,13 @@ enum ins_opcode_t {
 #endif
 	FREE,	// Deallocated a memory block
 	READ,	// Write data to a byte on memory
-	WRITE	// Read data from a byte on memory
+	WRITE,	// Read data from a byte on memory
+#ifdef MM_PAGING
+	MEMCPY,	// Copy bytes from a region to another
+	MEMSET,	// Fill bytes of a region with a value
+	MEMCMP,	// Compare bytes of two regions
+#endif
+	NR_OPCODES	// Not an instruction
 };
 
 /* instructions executed by the CPU */
@@ -40,11 +49,31 @@ struct inst_t {
 	uint32_t arg_0; // Argument lists for instructions
 	uint32_t arg_1;
 	uint32_t arg_2;
+	uint32_t arg_3;
+	uint32_t arg_4;
+};
+
+/* An instruction as run() executes it, decoded at load time: [op] is
+ * the address of its handler in run(), [cost] its cycles in the CPU
+ * model and the arguments those of inst_t */
+struct dinst_t {
+	const void * op;
+	uint32_t cost;
+	uint32_t fused;	// CALC: CALCs in a row from this one on, else 0
+	uint32_t arg_0;
+	uint32_t arg_1;
+	uint32_t arg_2;
+	uint32_t arg_3;
+	uint32_t arg_4;
 };
 
+/* Code of a program, shared read-only by the processes loaded from it */
 struct code_seg_t {
 	struct inst_t * text;
+	struct dinst_t * ops;	// [text] decoded by decode_code()
 	uint32_t size;
+	void * map;	// Process image [text] is mapped from, NULL if parsed
+	size_t map_len;
 };
 
 struct trans_table_t {
@@ -73,11 +102,40 @@ struct pcb_t {
 	struct code_seg_t * code;	// Code segment
 	addr_t regs[10]; // Registers, store address of allocated regions
 	uint32_t pc; // Program pointer, point to the next instruction
-#ifdef MLQ_SCHED
+	// CPU model: cycles the last instruction still owes beyond the
+	// slot it started in, and page faults taken so far
+	uint32_t stall;
+	uint32_t faults;
 	// Priority on execution (if supported), on-fly aka. changeable
 	// and this vale overwrites the default priority when it existed
 	uint32_t prio;     
-#endif
+	// MLFQ: prio the process was loaded with, and quanta it used up
+	// on its current level
+	uint32_t base_prio;
+	uint32_t allot;
+	// Fair scheduling: weighted virtual runtime, node in the run tree
+	// and the time slot the process was last dispatched at
+	uint64_t vruntime;
+	uint64_t exec_start;
+	struct rb_node run_node;
+	// Cache affinity: CPU the process last ran on (-1 before its first
+	// dispatch), times it moved to another CPU, and times it was passed
+	// over at the head of its queue in favour of an affine process
+	int last_cpu;
+	uint32_t migrations;
+	uint32_t skipped;
+	// Accounting, in time slots: when the process was first queued,
+	// first dispatched (UINT64_MAX before that), last made ready and
+	// finished, total time spent ready but not running, and number of
+	// dispatches
+	uint64_t arrival;
+	uint64_t first_run;
+	uint64_t ready_since;
+	uint64_t finish;
+	uint64_t wait;
+	uint32_t quanta;
+	// Real-time: absolute deadline slot, 0 if the process has none
+	uint64_t deadline;
 #ifdef MM_PAGING
 	struct mm_struct *mm;
 	struct memphy_struct *mram;
@@ -9,5 +9,22 @@
  * Otherwise, return 1. */
 int run(struct pcb_t * proc);
 
+/* Decode the text of [code] for run(), once it is loaded */
+void decode_code(struct code_seg_t * code);
+
+/* Set the CPU model from "cycles[,op=cost...]": the cycles a CPU has
+ * in a time slot and what an instruction costs, op being an opcode name
+ * or "fault" for the extra cost of each page fault it takes. Without
+ * it a slot has one cycle and everything costs one, so a CPU runs one
+ * instruction per slot. Every count must fit in 32 bits. Must come
+ * before any code is decoded. Return 0 on success */
+int cpu_set_model(const char * spec);
+
+/* Run [proc] for one time slot, as many instructions as its cycles
+ * allow. An instruction going past the end of the slot finishes in it
+ * but its extra cycles are taken from the next slots [proc] runs in.
+ * Return the number of instructions run */
+int run_slot(struct pcb_t * proc);
+
 #endif
 
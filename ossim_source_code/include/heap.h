@@ -0,0 +1,28 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "common.h"
+
+/* Binary min-heap of processes ordered by [less], grown on demand */
+struct heap_t {
+	struct pcb_t ** proc;
+	int size;
+	int cap;
+	int (*less)(struct pcb_t * a, struct pcb_t * b);
+};
+
+void heap_init(struct heap_t * h, int (*less)(struct pcb_t *, struct pcb_t *));
+
+void heap_destroy(struct heap_t * h);
+
+void heap_push(struct heap_t * h, struct pcb_t * proc);
+
+/* Remove and return the smallest process, NULL if [h] is empty */
+struct pcb_t * heap_pop(struct heap_t * h);
+
+static inline int heap_empty(struct heap_t * h) {
+	return h->size == 0;
+}
+
+#endif
+
@@ -0,0 +1,72 @@
+#ifndef LFQUEUE_H
+#define LFQUEUE_H
+
+#include <pthread.h>
+#include "common.h"
+#include "bitops.h"
+#include "queue.h"
+
+#define LF_RING_SIZE	1024	// Ring of each level before it spills, power of two
+#define LF_CACHELINE	64
+
+/* Bounded multi-producer/multi-consumer ring. Every cell carries a
+ * sequence number telling whether it is ready to be written (seq ==
+ * pos) or read (seq == pos + 1), so producers and consumers only race
+ * on one CAS of [tail] or [head] respectively. */
+struct lf_cell {
+	unsigned long seq;
+	struct pcb_t * proc;
+};
+
+struct lf_ring {
+	struct lf_cell * cell;
+	unsigned long mask;
+	unsigned long head __attribute__((aligned(LF_CACHELINE)));
+	unsigned long tail __attribute__((aligned(LF_CACHELINE)));
+};
+
+void lf_ring_init(struct lf_ring * r, unsigned long size);
+
+void lf_ring_destroy(struct lf_ring * r);
+
+/* Return 0 on success, 1 if the ring is full */
+int lf_ring_push(struct lf_ring * r, struct pcb_t * proc);
+
+/* Return NULL if the ring is empty */
+struct pcb_t * lf_ring_pop(struct lf_ring * r);
+
+/* One level of the lock-free MLQ. When the ring is full, processes
+ * spill to a growable queue under [spill_lock] rather than wait for
+ * consumers, which may be waiting on the producer themselves. Once
+ * anything has spilled, new processes go behind it and consumers move
+ * it back into the ring, so the level stays FIFO. */
+struct lf_level {
+	struct lf_ring ring;
+	pthread_mutex_t spill_lock;
+	struct queue_t spill;
+	int nr_spilled;	// spill.size, read without the lock
+};
+
+/* Lock-free MLQ. [ready_map] is only a hint of the levels that may be
+ * non-empty. Each [slot] word packs the round it belongs to in the
+ * high half and the slots left in the low half, so a new round is a
+ * single increment of [epoch] and levels refill lazily, like mlq_t. */
+struct lf_mlq {
+	struct lf_level level[MAX_PRIO];
+	uint64_t slot[MAX_PRIO];
+	DECLARE_BITMAP(ready_map, MAX_PRIO);
+	uint32_t epoch;
+};
+
+void lf_mlq_init(struct lf_mlq * mlq);
+
+void lf_mlq_destroy(struct lf_mlq * mlq);
+
+void lf_mlq_enqueue(struct lf_mlq * mlq, struct pcb_t * proc);
+
+struct pcb_t * lf_mlq_dequeue(struct lf_mlq * mlq);
+
+int lf_mlq_empty(struct lf_mlq * mlq);
+
+#endif
+
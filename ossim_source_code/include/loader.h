@@ -3,7 +3,36 @@
 
 #include "common.h"
 
+/*
+ * Compiled process image, written by mkimage from a process text: this
+ * header and then the [size] instructions as an array of inst_t, in the
+ * byte order of the host. load() maps it and runs the array in place.
+ * Opcode numbers and inst_t depend on the build, so both are checked
+ */
+#define IMAGE_MAGIC	0x4d49534f	/* "OSIM" */
+#define IMAGE_VERSION	1
+
+struct image_hdr {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nr_opcodes;	// NR_OPCODES of the build that wrote it
+	uint32_t inst_size;	// sizeof(struct inst_t) of that build
+	uint32_t priority;
+	uint32_t size;		// Number of instructions
+};
+
+/* Load the process at [path], an image or a process text. Processes
+ * loaded from the same path share one read-only code segment, read on
+ * the first load. The caller gives the process its pid */
 struct pcb_t * load(const char * path);
 
+/* A process done with [code] drops its reference, the last one frees it */
+void release_code(struct code_seg_t * code);
+
+/* Write [code] and [priority] as a process image to [path]. Return 0
+ * on success */
+int write_image(const char * path, uint32_t priority,
+		const struct code_seg_t * code);
+
 #endif
 
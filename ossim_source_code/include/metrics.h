@@ -0,0 +1,26 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "common.h"
+
+/* Scheduling metrics of a run, written out at exit. All times are in
+ * time slots */
+
+void metrics_init(int num_cpus);
+
+/* Record a process that ran to completion, its accounting fields in
+ * pcb_t must be final */
+void metrics_proc_done(struct pcb_t * proc);
+
+/* Add how many slots [cpu] spent running a process and idle, and how
+ * many times it dispatched one, over one of its online periods */
+void metrics_cpu(int cpu, uint64_t busy, uint64_t idle, uint64_t switches);
+
+/* Write everything recorded to [path], as JSON if it ends in ".json",
+ * CSV otherwise. Return 0 on success */
+int metrics_write(const char * path);
+
+void metrics_free(void);
+
+#endif
+
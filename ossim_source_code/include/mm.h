@@ -134,6 +134,7 @@ int __free(struct pcb_t *caller, int rgid);
 int __read(struct pcb_t *caller, int rgid, int offset, BYTE *data);
 int __write(struct pcb_t *caller, int rgid, int offset, BYTE value);
 int init_mm(struct mm_struct *mm, struct pcb_t *caller);
+void free_mm(struct pcb_t *caller);
 
 /* VM prototypes */
 int pgalloc(struct pcb_t *proc, uint32_t size, uint32_t reg_index);
@@ -149,6 +150,13 @@ int pgwrite(
 		BYTE data, // Data to be wrttien into memory
 		uint32_t destination, // Index of destination register
 		uint32_t offset);
+/* Block instructions, moving a page at a time */
+int pgmemcpy(struct pcb_t *proc, uint32_t dst, uint32_t dst_off,
+		uint32_t src, uint32_t src_off, uint32_t size);
+int pgmemset(struct pcb_t *proc, uint32_t dst, uint32_t dst_off,
+		uint32_t value, uint32_t size);
+int pgmemcmp(struct pcb_t *proc, uint32_t rg_a, uint32_t off_a,
+		uint32_t rg_b, uint32_t off_b, uint32_t size);
 /* Local VM prototypes */
 struct vm_rg_struct * get_symrg_byid(struct mm_struct* mm, int rgid);
 int validate_overlap_vm_area(struct pcb_t *caller, int vmaid, int vmastart, int vmaend);
@@ -160,8 +168,13 @@ struct vm_area_struct *get_vma_by_num(struct mm_struct *mm, int vmaid);
 /* MEM/PHY protypes */
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *fpn);
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn);
+int MEMPHY_put_usedfp(struct memphy_struct *mp, int fpn, struct mm_struct *owner);
+int MEMPHY_put_ownedfp(struct memphy_struct *mp, struct mm_struct *owner);
 int MEMPHY_read(struct memphy_struct * mp, int addr, BYTE *value);
 int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data);
+int MEMPHY_read_block(struct memphy_struct *mp, int addr, BYTE *buf, int n);
+int MEMPHY_write_block(struct memphy_struct *mp, int addr, const BYTE *buf, int n);
+int MEMPHY_set_block(struct memphy_struct *mp, int addr, BYTE value, int n);
 int MEMPHY_dump(struct memphy_struct * mp);
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg);
 /* DEBUG */
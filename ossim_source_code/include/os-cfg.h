@@ -4,6 +4,24 @@
 #define MLQ_SCHED 1
 #define MAX_PRIO 140
 
+/* MLFQ policy: a process drops MLFQ_STEP levels once it used up
+ * MLFQ_ALLOT quanta on its level, rises MLFQ_STEP levels for every
+ * MLFQ_AGE slots it waits ready, and every MLFQ_BOOST slots all are
+ * put back on the level they were loaded with */
+#define MLFQ_ALLOT 2
+#define MLFQ_STEP 10
+#define MLFQ_AGE 32
+#define MLFQ_BOOST 256
+
+/* Adaptive quantum: level l may grow up to time_slot * (1 + QUANTUM_SCALE
+ * * l / (MAX_PRIO - 1)), i.e. time_slot at prio 0, 8x at prio 139 */
+#define QUANTUM_SCALE 7
+
+/* Loader pool: threads loading processes ahead of their start time,
+ * and how many loaded processes may wait for it at most */
+#define LD_WORKERS 2
+#define LD_STAGE 64
+
 #define MM_PAGING
 #define MM_PAGING_HEAP_GODOWN
 // #define MM_FIXED_MEMSZ
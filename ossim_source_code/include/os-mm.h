@@ -79,7 +79,7 @@ struct memphy_struct {
    int rdmflg;
    int cursor;
 
-   /* Management structure */
+   /* Management structure, see fp_lock in mm-memphy.c */
    struct framephy_struct *free_fp_list;
    struct framephy_struct *used_fp_list;
 };
@@ -3,20 +3,61 @@
 #define QUEUE_H
 
 #include "common.h"
+#include "bitops.h"
 
-#define MAX_QUEUE_SIZE 10
+#define QUEUE_INIT_SIZE 8	// First capacity of a queue, power of two
 
+/* FIFO ring buffer of processes. [cap] is always a power of two so
+ * indexes wrap with a mask; the buffer doubles when it is full and
+ * is allocated on the first enqueue, so a zeroed queue is valid. */
 struct queue_t {
-	struct pcb_t * proc[MAX_QUEUE_SIZE];
+	struct pcb_t ** proc;
+	unsigned int head;	// Index of the oldest process
+	unsigned int cap;
 	int slot;
 	int size;
+	unsigned long epoch;	// MLQ round in which [slot] was last refilled
 };
 
 void enqueue(struct queue_t * q, struct pcb_t * proc);
 
 struct pcb_t * dequeue(struct queue_t * q);
 
+/* Like dequeue() but prefer a process that last ran on [cpu] among the
+ * first [bound] + 1 of [q]. The head can be passed over at most [bound]
+ * times in a row, [bound] = 0 is a plain dequeue() */
+struct pcb_t * dequeue_affine(struct queue_t * q, int cpu, unsigned int bound);
+
 int empty(struct queue_t * q);
 
+/* Multilevel ready queue. Instead of scanning every level, we keep
+ * a bitmap of the levels that still can be served in this round so
+ * the next level is found with a single find-first-set. A new round
+ * just bumps [epoch]; each level refills its slot lazily. */
+struct mlq_t {
+	struct queue_t level[MAX_PRIO];
+	DECLARE_BITMAP(ready_map, MAX_PRIO);	// non-empty with slot left
+	DECLARE_BITMAP(busy_map, MAX_PRIO);	// non-empty
+	unsigned long epoch;
+};
+
+void mlq_init(struct mlq_t * mlq);
+
+/* Release the ring buffers of every level */
+void mlq_destroy(struct mlq_t * mlq);
+
+void mlq_enqueue(struct mlq_t * mlq, struct pcb_t * proc);
+
+struct pcb_t * mlq_dequeue(struct mlq_t * mlq);
+
+/* mlq_dequeue() picking inside the chosen level with dequeue_affine() */
+struct pcb_t * mlq_dequeue_affine(struct mlq_t * mlq, int cpu, unsigned int bound);
+
+int mlq_empty(struct mlq_t * mlq);
+
+/* Let [update] change the prio of every queued process and move it to
+ * its new level. Processes ending up on the same level keep their order */
+void mlq_requeue(struct mlq_t * mlq, void (*update)(struct pcb_t * proc));
+
 #endif
 
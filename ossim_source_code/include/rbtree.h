@@ -0,0 +1,45 @@
+#ifndef RBTREE_H
+#define RBTREE_H
+
+#include <stddef.h>
+
+/* Intrusive red-black tree: the node is embedded in the object being
+ * sorted and rb_entry() gets the object back from its node */
+
+#define RB_RED		0
+#define RB_BLACK	1
+
+struct rb_node {
+	struct rb_node * parent;
+	struct rb_node * left;
+	struct rb_node * right;
+	int color;
+};
+
+/* Root of a tree, caching the leftmost node so the smallest one is
+ * found in O(1) */
+struct rb_root {
+	struct rb_node * node;
+	struct rb_node * leftmost;
+};
+
+#define rb_entry(ptr, type, member) \
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+/* Link [node] in [root] ordered by [less]; equal keys keep their
+ * insertion order */
+void rb_insert(struct rb_root * root, struct rb_node * node,
+		int (*less)(const struct rb_node *, const struct rb_node *));
+
+/* Unlink [node] from [root] */
+void rb_erase(struct rb_root * root, struct rb_node * node);
+
+/* In-order successor of [node], NULL if it is the last one */
+struct rb_node * rb_next(struct rb_node * node);
+
+static inline struct rb_node * rb_first(struct rb_root * root) {
+	return root->leftmost;
+}
+
+#endif
+
@@ -0,0 +1,27 @@
+#ifndef SAMPLES_H
+#define SAMPLES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Growable list of measurements with percentile lookup */
+struct samples_t {
+	uint64_t * v;
+	size_t n;
+	size_t cap;
+	int sorted;
+};
+
+void samples_add(struct samples_t * s, uint64_t value);
+
+/* Append every sample of [src] to [dst] */
+void samples_merge(struct samples_t * dst, struct samples_t * src);
+
+/* Value below which [pct] percent of the samples fall (nearest rank),
+ * 0 if there is no sample */
+uint64_t samples_pct(struct samples_t * s, double pct);
+
+void samples_free(struct samples_t * s);
+
+#endif
+
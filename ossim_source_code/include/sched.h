@@ -1,24 +1,99 @@
-#ifndef QUEUE_H
-#define QUEUE_H
+#ifndef SCHED_H
+#define SCHED_H
 
 #include "common.h"
-
-#ifndef MLQ_SCHED
-#define MLQ_SCHED
-#endif
+#include "samples.h"
 
 //#define MAX_PRIO 139
 
+/* A scheduling policy owns its ready queue(s) and is reached through
+ * this table, so every policy is available in the same binary */
+struct sched_policy {
+	const char * name;
+	void (*init)(int num_cpus);
+	void (*finish)(void);
+	int (*empty)(void);
+	struct pcb_t * (*get)(int cpu);
+	void (*put)(struct pcb_t * proc, int cpu);
+	void (*add)(struct pcb_t * proc);
+	/* Optional, for policies keeping per-CPU state: [cpu] was
+	 * plugged in, or unplugged and its processes must move away */
+	void (*cpu_online)(int cpu);
+	void (*cpu_offline)(int cpu);
+};
+
+extern struct sched_policy fifo_policy;		// Round robin, one queue
+extern struct sched_policy mlq_policy;		// Single MLQ for every CPU
+extern struct sched_policy percpu_policy;	// Per-CPU MLQ, work stealing
+extern struct sched_policy lockfree_policy;	// MLQ of lock-free rings
+extern struct sched_policy cfs_policy;		// Weighted vruntime, rb tree
+extern struct sched_policy mlfq_policy;		// MLQ with demotion and aging
+
+/* Real-time class in front of the selected policy: processes with a
+ * deadline are queued here and always dispatched first, earliest
+ * deadline first */
+extern struct sched_policy edf_class;
+
 int queue_empty(void);
 
-void init_scheduler(void);
+/* Select the policy called [name], must be called before
+ * init_scheduler(). The default is mlq. Return 0 if [name] is known,
+ * otherwise 1 */
+int sched_set_policy(const char * name);
+
+const char * sched_policy_name(void);
+
+/* Names of the known policies, separated by '|' */
+const char * sched_policy_list(void);
+
+/* Let fifo and mlq prefer a process which last ran on the calling CPU
+ * over the head of the queue, passing the head over at most [bound]
+ * times in a row. 0 (the default) keeps strict queue order. percpu is
+ * affine by construction, the other policies ignore it */
+void sched_set_affinity(unsigned int bound);
+
+/* Give every level a quantum of [time_slot] slots per dispatch */
+void sched_set_quantum(unsigned int time_slot);
+
+/* Per-level quanta from [spec], comma separated "level:slots" or
+ * "from-to:slots" (other levels keep theirs), or "auto" to adapt them
+ * online: a level grows by one slot each time a process uses up its
+ * quantum and shrinks when processes finish early. Return 0 on success */
+int sched_parse_quantum(const char * spec);
+
+/* Slots [proc] may run for from this dispatch */
+unsigned int sched_quantum(struct pcb_t * proc);
+
+/* [proc] finished with [left] slots of its quantum unused */
+void sched_proc_done(struct pcb_t * proc, unsigned int left);
+
+/* Number of finished processes which had a deadline, and of those
+ * finished after it */
+void sched_deadline_stats(unsigned int * jobs, unsigned int * missed);
+
+/* Call [notify] each time add_proc() or put_proc() queues a process */
+void sched_set_notify(void (*notify)(void));
+
+/* Measure how long every get_proc() takes, must be called before
+ * init_scheduler() */
+void sched_enable_stats(void);
+
+/* Append the get_proc() latencies of every CPU, in ns, to [out] */
+void sched_dispatch_latency(struct samples_t * out);
+
+/* [num_cpus] is the most CPUs ever online at once */
+void init_scheduler(int num_cpus);
+
+/* CPU hot-plug, [cpu] below the count given to init_scheduler() */
+void sched_cpu_online(int cpu);
+void sched_cpu_offline(int cpu);
 void finish_scheduler(void);
 
-/* Get the next process from ready queue */
-struct pcb_t * get_proc(void);
+/* Get the next process for CPU [cpu] from ready queue */
+struct pcb_t * get_proc(int cpu);
 
-/* Put a process back to run queue */
-void put_proc(struct pcb_t * proc);
+/* Put a process back to run queue of CPU [cpu] */
+void put_proc(struct pcb_t * proc, int cpu);
 
 /* Add a new process to ready queue */
 void add_proc(struct pcb_t * proc);
@@ -5,24 +5,42 @@
 #include <stdint.h>
 
 struct timer_id_t {
-	int done;
 	int fsh;
-	pthread_cond_t event_cond;
-	pthread_mutex_t event_lock;
-	pthread_cond_t timer_cond;
-	pthread_mutex_t timer_lock;
+	int parked;	// 1 if parking at its next slot, 2 once out of the barrier
+	int background;	// Does not keep time going on its own
+	pthread_cond_t park_cond;
 };
 
 void start_timer();
 
 void stop_timer();
 
+/* Add a device time has to wait for, also while the timer runs */
 struct timer_id_t * attach_event();
 
 void detach_event(struct timer_id_t * event);
 
 void next_slot(struct timer_id_t* timer_id);
 
+/* Idle until current_time() reaches [slot]. Slots no other device needs
+ * meanwhile are skipped at once instead of stepped through. Return 1
+ * early, without moving time, if only background devices are left */
+int next_slot_until(struct timer_id_t * timer_id, uint64_t slot);
+
+/* Mark [timer_id] as a background device, see next_slot_until() */
+void timer_set_background(struct timer_id_t * timer_id);
+
+/* End the current slot and go on at [slot], or the next one if that
+ * is earlier. Only for a caller driving time alone, without devices */
+void timer_advance(uint64_t slot);
+
+/* Take [timer_id] out of the slot barrier: time goes on without it and
+ * its next call to next_slot() only returns after timer_unpark(), in
+ * the slot it was unparked in */
+void timer_park(struct timer_id_t * timer_id);
+
+void timer_unpark(struct timer_id_t * timer_id);
+
 uint64_t current_time();
 
 #endif
@@ -2,6 +2,43 @@
 #include "cpu.h"
 #include "mem.h"
 #include "mm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* CPU model, see cpu_set_model() */
+static uint32_t slot_cycles = 1;
+static uint32_t fault_cycles = 0;
+static uint32_t op_cycles[] = {
+	[CALC]	= 1,
+	[ALLOC]	= 1,
+#ifdef MM_PAGING
+	[MALLOC] = 1,
+#endif
+	[FREE]	= 1,
+	[READ]	= 1,
+	[WRITE]	= 1,
+#ifdef MM_PAGING
+	[MEMCPY] = 1,
+	[MEMSET] = 1,
+	[MEMCMP] = 1,
+#endif
+};
+static const char * const op_name[] = {
+	[CALC]	= "calc",
+	[ALLOC]	= "alloc",
+#ifdef MM_PAGING
+	[MALLOC] = "malloc",
+#endif
+	[FREE]	= "free",
+	[READ]	= "read",
+	[WRITE]	= "write",
+#ifdef MM_PAGING
+	[MEMCPY] = "memcpy",
+	[MEMSET] = "memset",
+	[MEMCMP] = "memcmp",
+#endif
+};
 
 int calc(struct pcb_t * proc) {
 	// return ((unsigned long)proc & 0UL);
@@ -46,58 +83,170 @@ int write(
 	return write_mem(proc->regs[destination] + offset, proc, data);
 } 
 
-int  run(struct pcb_t * proc) {
+/* Handlers of run(), indexed by opcode, published by run(NULL) */
+static const void * const * handlers;
+
+/*
+ *  Threaded code: every instruction was decoded by decode_code() into
+ *  the address of its handler below, with its arguments, so running
+ *  one is a single indirect jump and no decision is taken here on
+ *  its opcode or on the memory model.
+ */
+int run(struct pcb_t * proc) {
+	static const void * const table[] = {
+		[CALC]	= &&op_calc,
+		[ALLOC]	= &&op_alloc,
+#ifdef MM_PAGING
+		[MALLOC] = &&op_malloc,
+#endif
+		[FREE]	= &&op_free,
+		[READ]	= &&op_read,
+		[WRITE]	= &&op_write,
+#ifdef MM_PAGING
+		[MEMCPY] = &&op_memcpy,
+		[MEMSET] = &&op_memset,
+		[MEMCMP] = &&op_memcmp,
+#endif
+	};
+	const struct dinst_t * ins;
+
+	if (proc == NULL) {
+		__atomic_store_n(&handlers, table, __ATOMIC_RELEASE);
+		return 0;
+	}
 	/* Check if Program Counter point to the proper instruction */
 	if (proc->pc >= proc->code->size) {
 		return 1;
 	}
-	
-	struct inst_t ins = proc->code->text[proc->pc];
+	ins = &proc->code->ops[proc->pc];
 	proc->pc++;
-	int stat = 1;
-	switch (ins.opcode) {
-	case CALC:
-		stat = calc(proc);
-		break;
-	case ALLOC:
-#ifdef MM_PAGING
-		stat = pgalloc(proc, ins.arg_0, ins.arg_1);
+	goto *ins->op;
 
-#else
-		stat = alloc(proc, ins.arg_0, ins.arg_1);
-#endif
-		break;
-#ifdef MM_PAGING
-	case MALLOC:
-		stat = pgmalloc(proc, ins.arg_0, ins.arg_1);
-		break;
-#endif
-	case FREE:
-#ifdef MM_PAGING
-		stat = pgfree_data(proc, ins.arg_0);
-#else
-		stat = free_data(proc, ins.arg_0);
-#endif
-		break;
-	case READ:
+op_calc:
+	return calc(proc);
+op_alloc:
 #ifdef MM_PAGING
-		stat = pgread(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return pgalloc(proc, ins->arg_0, ins->arg_1);
+op_malloc:
+	return pgmalloc(proc, ins->arg_0, ins->arg_1);
+op_free:
+	return pgfree_data(proc, ins->arg_0);
+op_read:
+	return pgread(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+op_write:
+	return pgwrite(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+op_memcpy:
+	return pgmemcpy(proc, ins->arg_0, ins->arg_1, ins->arg_2,
+		ins->arg_3, ins->arg_4);
+op_memset:
+	return pgmemset(proc, ins->arg_0, ins->arg_1, ins->arg_2,
+		ins->arg_3);
+op_memcmp:
+	return pgmemcmp(proc, ins->arg_0, ins->arg_1, ins->arg_2,
+		ins->arg_3, ins->arg_4);
 #else
-		stat = read(proc, ins.arg_0, ins.arg_1, ins.arg_2);
+	return alloc(proc, ins->arg_0, ins->arg_1);
+op_free:
+	return free_data(proc, ins->arg_0);
+op_read:
+	return read(proc, ins->arg_0, ins->arg_1, ins->arg_2);
+op_write:
+	return write(proc, ins->arg_0, ins->arg_1, ins->arg_2);
 #endif
-		break;
-	case WRITE:
-#ifdef MM_PAGING
-		stat = pgwrite(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#else
-		stat = write(proc, ins.arg_0, ins.arg_1, ins.arg_2);
-#endif
-		break;
-	default:
-		stat = 1;
-	}
-	return stat;
+}
 
+void decode_code(struct code_seg_t * code) {
+	uint32_t i;
+	if (__atomic_load_n(&handlers, __ATOMIC_ACQUIRE) == NULL)
+		run(NULL);
+	code->ops = (struct dinst_t*)malloc(
+		sizeof(struct dinst_t) * code->size
+	);
+	for (i = 0; i < code->size; i++) {
+		struct inst_t * in = &code->text[i];
+		if ((uint32_t)in->opcode >= NR_OPCODES) {
+			printf("Opcode: %d\n", in->opcode);
+			exit(1);
+		}
+		code->ops[i].op = handlers[in->opcode];
+		code->ops[i].cost = op_cycles[in->opcode];
+		code->ops[i].arg_0 = in->arg_0;
+		code->ops[i].arg_1 = in->arg_1;
+		code->ops[i].arg_2 = in->arg_2;
+		code->ops[i].arg_3 = in->arg_3;
+		code->ops[i].arg_4 = in->arg_4;
+	}
+	/* Fuse runs of CALC, which only take time, into superinstructions
+	 * run_slot() retires at once. Every CALC of a run knows how many
+	 * are left so that the run can be entered anywhere */
+	for (i = code->size; i-- > 0; ) {
+		if (code->text[i].opcode != CALC)
+			code->ops[i].fused = 0;
+		else if (i + 1 < code->size)
+			code->ops[i].fused = code->ops[i + 1].fused + 1;
+		else
+			code->ops[i].fused = 1;
+	}
 }
 
+int cpu_set_model(const char * spec) {
+	char name[16];
+	unsigned long cycles;
+	int len;
+	uint32_t op;
+	/* Every count is kept in 32 bits, refuse what would not fit */
+	if (sscanf(spec, "%lu%n", &cycles, &len) != 1 || cycles == 0
+			|| cycles > UINT32_MAX)
+		return 1;
+	slot_cycles = cycles;
+	for (spec += len; *spec != '\0'; spec += len) {
+		if (sscanf(spec, ",%15[a-z]=%lu%n", name, &cycles, &len) != 2
+				|| cycles > UINT32_MAX)
+			return 1;
+		if (!strcmp(name, "fault")) {
+			fault_cycles = cycles;
+			continue;
+		}
+		for (op = 0; op < NR_OPCODES; op++)
+			if (!strcmp(name, op_name[op]))
+				break;
+		if (op == NR_OPCODES)
+			return 1;
+		op_cycles[op] = cycles;
+	}
+	return 0;
+}
 
+int run_slot(struct pcb_t * proc) {
+	uint64_t used = proc->stall;
+	int n = 0;
+	if (used >= slot_cycles) {
+		/* Still busy with the last instruction */
+		proc->stall -= slot_cycles;
+		return 0;
+	}
+	while (used < slot_cycles && proc->pc < proc->code->size) {
+		const struct dinst_t * ins = &proc->code->ops[proc->pc];
+		uint32_t faults = proc->faults;
+		if (ins->fused > 1) {
+			/* As many CALCs as start before the slot ends */
+			uint64_t k = ins->fused;
+			if (ins->cost > 0) {
+				uint64_t fit = (slot_cycles - used + ins->cost - 1)
+					/ ins->cost;
+				if (fit < k)
+					k = fit;
+			}
+			proc->pc += k;
+			used += k * ins->cost;
+			n += k;
+			continue;
+		}
+		used += ins->cost;
+		run(proc);
+		used += (uint64_t)(proc->faults - faults) * fault_cycles;
+		n++;
+	}
+	proc->stall = used > slot_cycles ? used - slot_cycles : 0;
+	return n;
+}
@@ -0,0 +1,371 @@
+
+#include "os-cfg.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+/*
+ * Synthetic workload generator: writes a configure file input/[name]
+ * and the programs it runs, input/proc/[name]-[k], from parameters. The
+ * same parameters and seed always give the same files.
+ *
+ * Processes draw their program among [programs] distinct ones, so that
+ * large runs share code (see load()). A program allocates its working
+ * set of [regions] regions of [size] bytes, runs about [length]
+ * instructions drawn from the instruction mix, then frees it all.
+ *
+ * Usage: gen-workload [options] [name]
+ *  -n processes		default 100
+ *  -c cpus, -t time slot	default 4, 2
+ *  -s seed			default 1
+ *  -p programs, -l length	default 16, 100
+ *  -a arrivals		poisson:rate (per slot, default 1),
+ *				uniform:span or burst:size:gap
+ *  -P priorities		prio or from-to with an optional :weight,
+ *				comma separated, default 0-139
+ *  -m instruction mix		op=weight,... out of calc read write memcpy
+ *				memset memcmp, default calc=6,read=2,write=2
+ *  -w working set		regions:size, default 4:256
+ *  -L locality		chance in [0, 1] that an access lands next to
+ *				the last one instead of anywhere, default 0.8
+ *  -x policy			written on the first line of the config
+ */
+
+#define MAX_REGIONS	10	// Registers of a process
+#define NEAR		16	// Bytes around the last access counted as near
+
+enum gen_op { G_CALC, G_READ, G_WRITE, G_MEMCPY, G_MEMSET, G_MEMCMP, NR_GEN_OPS };
+static const char * const op_name[NR_GEN_OPS] = {
+	"calc", "read", "write", "memcpy", "memset", "memcmp"
+};
+
+static unsigned long nprocs = 100;
+static int cpus = 4, time_slot = 2;
+static unsigned long seed = 1;
+static unsigned int nprogs = 16, length = 100;
+static unsigned int regions = 4, region_size = 256;
+static double locality = 0.8;
+static const char * policy = NULL;
+
+/* Arrivals */
+enum { A_POISSON, A_UNIFORM, A_BURST };
+static int arrival = A_POISSON;
+static double rate = 1.0;
+static unsigned long span, burst_size, burst_gap;
+
+static unsigned int mix[NR_GEN_OPS] = { 6, 2, 2, 0, 0, 0 };
+static unsigned int prio_weight[MAX_PRIO];
+
+/* xorshift64*, so that a seed gives the same workload with any libc */
+static uint64_t rng_state;
+
+static uint64_t rng(void) {
+	rng_state ^= rng_state >> 12;
+	rng_state ^= rng_state << 25;
+	rng_state ^= rng_state >> 27;
+	return rng_state * 2685821657736338717ULL;
+}
+
+/* Uniform in [0, n) */
+static uint64_t rng_below(uint64_t n) {
+	return n ? rng() % n : 0;
+}
+
+/* Uniform in [0, 1) */
+static double rng_unit(void) {
+	return (rng() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Index drawn from [n] weights summing to [total] */
+static unsigned int rng_weighted(const unsigned int * weight, unsigned int n,
+		uint64_t total) {
+	uint64_t r = rng_below(total);
+	unsigned int i;
+	for (i = 0; i + 1 < n && r >= weight[i]; i++)
+		r -= weight[i];
+	return i;
+}
+
+static int parse_arrivals(const char * spec) {
+	if (sscanf(spec, "poisson:%lf", &rate) == 1 && rate > 0) {
+		arrival = A_POISSON;
+		return 0;
+	}
+	if (sscanf(spec, "uniform:%lu", &span) == 1) {
+		arrival = A_UNIFORM;
+		return 0;
+	}
+	if (sscanf(spec, "burst:%lu:%lu", &burst_size, &burst_gap) == 2
+			&& burst_size > 0) {
+		arrival = A_BURST;
+		return 0;
+	}
+	return 1;
+}
+
+/* "prio[-prio][:weight],..." */
+static int parse_prios(const char * spec) {
+	unsigned int from, to, weight, p;
+	int len;
+	memset(prio_weight, 0, sizeof(prio_weight));
+	while (*spec != '\0') {
+		if (sscanf(spec, "%u%n", &from, &len) != 1)
+			return 1;
+		spec += len;
+		to = from;
+		if (*spec == '-' && sscanf(spec, "-%u%n", &to, &len) == 1)
+			spec += len;
+		weight = 1;
+		if (*spec == ':' && sscanf(spec, ":%u%n", &weight, &len) == 1)
+			spec += len;
+		if (from > to || to >= MAX_PRIO)
+			return 1;
+		for (p = from; p <= to; p++)
+			prio_weight[p] = weight;
+		if (*spec == ',')
+			spec++;
+		else if (*spec != '\0')
+			return 1;
+	}
+	return 0;
+}
+
+/* "op=weight,..." */
+static int parse_mix(const char * spec) {
+	char name[16];
+	unsigned int weight, op;
+	int len;
+	memset(mix, 0, sizeof(mix));
+	while (*spec != '\0') {
+		if (sscanf(spec, "%15[a-z]=%u%n", name, &weight, &len) != 2)
+			return 1;
+		for (op = 0; op < NR_GEN_OPS; op++)
+			if (!strcmp(name, op_name[op]))
+				break;
+		if (op == NR_GEN_OPS)
+			return 1;
+		mix[op] = weight;
+		spec += len;
+		if (*spec == ',')
+			spec++;
+		else if (*spec != '\0')
+			return 1;
+	}
+	return 0;
+}
+
+/* Where the last access went, for locality */
+struct cursor {
+	unsigned int region;
+	unsigned int offset;
+};
+
+/* Next byte accessed, near the last one with chance [locality] */
+static void next_access(struct cursor * cur) {
+	if (rng_unit() < locality) {
+		long off = (long)cur->offset + (long)rng_below(2 * NEAR + 1) - NEAR;
+		if (off < 0)
+			off = 0;
+		if (off >= region_size)
+			off = region_size - 1;
+		cur->offset = off;
+	} else {
+		cur->region = rng_below(regions);
+		cur->offset = rng_below(region_size);
+	}
+}
+
+/* Bytes from [cur] on for a block instruction, within the region */
+static unsigned int block_len(struct cursor * cur) {
+	return 1 + rng_below(region_size - cur->offset);
+}
+
+static void write_program(FILE * f, unsigned int prio) {
+	uint64_t total = 0;
+	struct cursor cur = { 0, 0 };
+	unsigned int body, i, op, n;
+	for (op = 0; op < NR_GEN_OPS; op++)
+		total += mix[op];
+	/* Length uniform in [length / 2, 3 * length / 2] */
+	body = length / 2 + rng_below(length + 1);
+	fprintf(f, "%u %u\n", prio, body + 2 * regions);
+	for (i = 0; i < regions; i++)
+		fprintf(f, "alloc %u %u\n", region_size, i);
+	for (i = 0; i < body; i++) {
+		struct cursor src;
+		op = rng_weighted(mix, NR_GEN_OPS, total);
+		if (op == G_CALC) {
+			fprintf(f, "calc\n");
+			continue;
+		}
+		next_access(&cur);
+		switch (op) {
+		case G_READ:
+			fprintf(f, "read %u %u 0\n", cur.region, cur.offset);
+			break;
+		case G_WRITE:
+			fprintf(f, "write %u %u %u\n", (unsigned int)rng_below(256),
+				cur.region, cur.offset);
+			break;
+		case G_MEMSET:
+			fprintf(f, "memset %u %u %u %u\n", cur.region, cur.offset,
+				(unsigned int)rng_below(256), block_len(&cur));
+			break;
+		default:
+			/* Both ends fit their region */
+			src.region = rng_below(regions);
+			src.offset = rng_below(region_size);
+			n = block_len(&cur);
+			if (n > region_size - src.offset)
+				n = region_size - src.offset;
+			fprintf(f, "%s %u %u %u %u %u\n", op_name[op], cur.region,
+				cur.offset, src.region, src.offset, n);
+		}
+	}
+	for (i = 0; i < regions; i++)
+		fprintf(f, "free %u\n", i);
+}
+
+/* Start slot of the [i]th process, never before the one of [i - 1] */
+static unsigned long next_arrival(unsigned long i, double * clock) {
+	switch (arrival) {
+	case A_UNIFORM:
+		/* Evenly spread then jittered, so they stay in order */
+		return span * i / nprocs + rng_below(span / nprocs + 1) / 2;
+	case A_BURST:
+		return i / burst_size * burst_gap;
+	default:
+		*clock += -log(1.0 - rng_unit()) / rate;
+		return (unsigned long)*clock;
+	}
+}
+
+static void usage(void) {
+	printf("Usage: gen-workload [-n processes] [-c cpus] [-t time slot]"
+		" [-s seed] [-p programs] [-l length]"
+		" [-a poisson:rate|uniform:span|burst:size:gap]"
+		" [-P prio[-prio][:weight],...] [-m op=weight,...]"
+		" [-w regions:size] [-L locality] [-x policy] [name]\n");
+}
+
+int main(int argc, char * argv[]) {
+	char path[4096];
+	unsigned int * prog_prio;
+	unsigned long i, start, last = 0;
+	uint64_t prio_total = 0;
+	double clock = 0;
+	unsigned int k;
+	FILE * f;
+	int opt;
+
+	parse_prios("0-139");
+	while ((opt = getopt(argc, argv, "a:c:l:m:n:p:s:t:w:x:L:P:")) != -1) {
+		switch (opt) {
+		case 'a':
+			if (parse_arrivals(optarg)) {
+				printf("Malformed arrivals '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'c':
+			cpus = atoi(optarg);
+			break;
+		case 'l':
+			length = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':
+			if (parse_mix(optarg)) {
+				printf("Malformed instruction mix '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'n':
+			nprocs = strtoul(optarg, NULL, 10);
+			break;
+		case 'p':
+			nprogs = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			time_slot = atoi(optarg);
+			break;
+		case 'w':
+			if (sscanf(optarg, "%u:%u", &regions, &region_size) != 2
+					|| regions == 0 || regions > MAX_REGIONS
+					|| region_size == 0) {
+				printf("Malformed working set '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'x':
+			policy = optarg;
+			break;
+		case 'L':
+			locality = atof(optarg);
+			break;
+		case 'P':
+			if (parse_prios(optarg)) {
+				printf("Malformed priorities '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind != argc - 1 || nprocs == 0 || nprogs == 0 || cpus <= 0) {
+		usage();
+		return 1;
+	}
+	for (k = 0; k < MAX_PRIO; k++)
+		prio_total += prio_weight[k];
+	if (prio_total == 0 || mix[G_CALC] + mix[G_READ] + mix[G_WRITE]
+			+ mix[G_MEMCPY] + mix[G_MEMSET] + mix[G_MEMCMP] == 0) {
+		usage();
+		return 1;
+	}
+	/* Never start from the all zero state xorshift stays in */
+	rng_state = seed * 0x9E3779B97F4A7C15ULL + 1;
+
+	/* Programs, each with its own priority */
+	prog_prio = malloc(sizeof(unsigned int) * nprogs);
+	for (k = 0; k < nprogs; k++) {
+		prog_prio[k] = rng_weighted(prio_weight, MAX_PRIO, prio_total);
+		snprintf(path, sizeof(path), "input/proc/%s-%u", argv[optind], k);
+		if ((f = fopen(path, "w")) == NULL) {
+			printf("Cannot write program to %s\n", path);
+			return 1;
+		}
+		write_program(f, prog_prio[k]);
+		fclose(f);
+	}
+
+	/* Configure file, as read_config() expects it */
+	snprintf(path, sizeof(path), "input/%s", argv[optind]);
+	if ((f = fopen(path, "w")) == NULL) {
+		printf("Cannot write configure file to %s\n", path);
+		return 1;
+	}
+	fprintf(f, "%d %d %lu", time_slot, cpus, nprocs);
+	if (policy != NULL)
+		fprintf(f, " %s", policy);
+	fprintf(f, "\n1048576 16777216 0 0 0 3145728\n");
+	for (i = 0; i < nprocs; i++) {
+		start = next_arrival(i, &clock);
+		if (start < last)
+			start = last;
+		last = start;
+		k = rng_below(nprogs);
+		fprintf(f, "%lu %s-%u %u\n", start, argv[optind], k,
+			prog_prio[k]);
+	}
+	fclose(f);
+	free(prog_prio);
+	return 0;
+}
@@ -0,0 +1,58 @@
+
+#include "heap.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void heap_init(struct heap_t * h, int (*less)(struct pcb_t *, struct pcb_t *)) {
+	h->proc = NULL;
+	h->size = h->cap = 0;
+	h->less = less;
+}
+
+void heap_destroy(struct heap_t * h) {
+	free(h->proc);
+	h->proc = NULL;
+	h->size = h->cap = 0;
+}
+
+void heap_push(struct heap_t * h, struct pcb_t * proc) {
+	int i, parent;
+	if (h->size == h->cap) {
+		int cap = h->cap ? h->cap << 1 : 16;
+		struct pcb_t ** p = realloc(h->proc, sizeof(struct pcb_t *) * cap);
+		if (p == NULL) {
+			printf("Cannot grow heap to %d entries\n", cap);
+			exit(1);
+		}
+		h->proc = p;
+		h->cap = cap;
+	}
+	/* Sift up from the new leaf */
+	for (i = h->size++; i > 0; i = parent) {
+		parent = (i - 1) / 2;
+		if (!h->less(proc, h->proc[parent]))
+			break;
+		h->proc[i] = h->proc[parent];
+	}
+	h->proc[i] = proc;
+}
+
+struct pcb_t * heap_pop(struct heap_t * h) {
+	struct pcb_t * top, * last;
+	int i, child;
+	if (h->size == 0)
+		return NULL;
+	top = h->proc[0];
+	last = h->proc[--h->size];
+	/* Sift the last leaf down from the root */
+	for (i = 0; (child = 2 * i + 1) < h->size; i = child) {
+		if (child + 1 < h->size && h->less(h->proc[child + 1], h->proc[child]))
+			child++;
+		if (!h->less(h->proc[child], last))
+			break;
+		h->proc[i] = h->proc[child];
+	}
+	h->proc[i] = last;
+	return top;
+}
+
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lfqueue.h"
+
+#define LOAD(p)		__atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v)	__atomic_store_n(p, v, __ATOMIC_RELEASE)
+#define CAS(p, old, new) \
+	__atomic_compare_exchange_n(p, old, new, 1, \
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+
+void lf_ring_init(struct lf_ring * r, unsigned long size) {
+	unsigned long pos;
+	r->cell = malloc(sizeof(struct lf_cell) * size);
+	if (r->cell == NULL) {
+		printf("Cannot allocate lock-free ring of %lu entries\n", size);
+		exit(1);
+	}
+	for (pos = 0; pos < size; pos++)
+		r->cell[pos].seq = pos;
+	r->mask = size - 1;
+	r->head = 0;
+	r->tail = 0;
+}
+
+void lf_ring_destroy(struct lf_ring * r) {
+	free(r->cell);
+	r->cell = NULL;
+}
+
+int lf_ring_push(struct lf_ring * r, struct pcb_t * proc) {
+	struct lf_cell * cell;
+	unsigned long pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+	while (1) {
+		cell = &r->cell[pos & r->mask];
+		long diff = (long)LOAD(&cell->seq) - (long)pos;
+		if (diff == 0) {
+			if (CAS(&r->tail, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return 1;	/* The consumers are a lap behind */
+		} else {
+			pos = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+		}
+	}
+	cell->proc = proc;
+	STORE(&cell->seq, pos + 1);
+	return 0;
+}
+
+struct pcb_t * lf_ring_pop(struct lf_ring * r) {
+	struct lf_cell * cell;
+	struct pcb_t * proc;
+	unsigned long pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+	while (1) {
+		cell = &r->cell[pos & r->mask];
+		long diff = (long)LOAD(&cell->seq) - (long)(pos + 1);
+		if (diff == 0) {
+			if (CAS(&r->head, &pos, pos + 1))
+				break;
+		} else if (diff < 0) {
+			return NULL;	/* Nothing published at [pos] yet */
+		} else {
+			pos = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+		}
+	}
+	proc = cell->proc;
+	STORE(&cell->seq, pos + r->mask + 1);
+	return proc;
+}
+
+static int lf_ring_empty(struct lf_ring * r) {
+	return LOAD(&r->head) == LOAD(&r->tail);
+}
+
+static void lf_level_push(struct lf_level * l, struct pcb_t * proc) {
+	if (LOAD(&l->nr_spilled) == 0 && !lf_ring_push(&l->ring, proc))
+		return;
+	pthread_mutex_lock(&l->spill_lock);
+	enqueue(&l->spill, proc);
+	STORE(&l->nr_spilled, l->spill.size);
+	pthread_mutex_unlock(&l->spill_lock);
+}
+
+/* Move what spilled back into the ring, as far as it has room */
+static void lf_level_refill(struct lf_level * l) {
+	pthread_mutex_lock(&l->spill_lock);
+	while (!empty(&l->spill)) {
+		if (lf_ring_push(&l->ring, l->spill.proc[l->spill.head]))
+			break;
+		dequeue(&l->spill);
+	}
+	STORE(&l->nr_spilled, l->spill.size);
+	pthread_mutex_unlock(&l->spill_lock);
+}
+
+static struct pcb_t * lf_level_pop(struct lf_level * l) {
+	struct pcb_t * proc = lf_ring_pop(&l->ring);
+	if (LOAD(&l->nr_spilled) == 0)
+		return proc;
+	lf_level_refill(l);
+	return proc != NULL ? proc : lf_ring_pop(&l->ring);
+}
+
+static int lf_level_empty(struct lf_level * l) {
+	return lf_ring_empty(&l->ring) && LOAD(&l->nr_spilled) == 0;
+}
+
+void lf_mlq_init(struct lf_mlq * mlq) {
+	int prio;
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		struct lf_level * l = &mlq->level[prio];
+		lf_ring_init(&l->ring, LF_RING_SIZE);
+		pthread_mutex_init(&l->spill_lock, NULL);
+		memset(&l->spill, 0, sizeof(l->spill));
+		l->nr_spilled = 0;
+		mlq->slot[prio] = MAX_PRIO - prio;
+	}
+	memset(mlq->ready_map, 0, sizeof(mlq->ready_map));
+	mlq->epoch = 0;
+}
+
+void lf_mlq_destroy(struct lf_mlq * mlq) {
+	int prio;
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		struct lf_level * l = &mlq->level[prio];
+		lf_ring_destroy(&l->ring);
+		pthread_mutex_destroy(&l->spill_lock);
+		free(l->spill.proc);
+	}
+}
+
+static void lf_set_ready(struct lf_mlq * mlq, int prio) {
+	__atomic_fetch_or(&mlq->ready_map[BITMAP_WORD(prio)],
+			BITMAP_MASK(prio), __ATOMIC_SEQ_CST);
+}
+
+static void lf_clear_ready(struct lf_mlq * mlq, int prio) {
+	__atomic_fetch_and(&mlq->ready_map[BITMAP_WORD(prio)],
+			~BITMAP_MASK(prio), __ATOMIC_SEQ_CST);
+}
+
+/* Level [prio] was found empty: clear its hint, then recheck after
+ * clearing so a racing push is not lost */
+static void lf_drop_stale(struct lf_mlq * mlq, int prio) {
+	lf_clear_ready(mlq, prio);
+	if (!lf_level_empty(&mlq->level[prio]))
+		lf_set_ready(mlq, prio);
+}
+
+/* Consume one slot of level [prio] in the current round, return 0 if
+ * it has none left. A word left from an older round is refilled. */
+static int lf_take_slot(struct lf_mlq * mlq, int prio) {
+	uint64_t old = LOAD(&mlq->slot[prio]), new;
+	do {
+		uint32_t epoch = LOAD(&mlq->epoch);
+		uint32_t left = (uint32_t)old;
+		if ((uint32_t)(old >> 32) != epoch)
+			left = MAX_PRIO - prio;
+		if (left == 0)
+			return 0;
+		new = ((uint64_t)epoch << 32) | (left - 1);
+	} while (!CAS(&mlq->slot[prio], &old, new));
+	return 1;
+}
+
+void lf_mlq_enqueue(struct lf_mlq * mlq, struct pcb_t * proc) {
+	if (mlq == NULL || proc->prio >= MAX_PRIO)	return;
+	lf_level_push(&mlq->level[proc->prio], proc);
+	lf_set_ready(mlq, proc->prio);
+}
+
+struct pcb_t * lf_mlq_dequeue(struct lf_mlq * mlq) {
+	int round;
+	if (mlq == NULL)	return NULL;
+	for (round = 0; round < 2; round++) {
+		uint32_t epoch = LOAD(&mlq->epoch);
+		int word, starved = 0;	// A level with work is out of slot
+		for (word = 0; word < (int)BITS_TO_LONGS(MAX_PRIO); word++) {
+			unsigned long bits = LOAD(&mlq->ready_map[word]);
+			while (bits) {
+				int prio = word * BITS_PER_ULONG + __builtin_ctzl(bits);
+				bits &= bits - 1;
+				if (!lf_take_slot(mlq, prio)) {
+					/* Only work left over ends the round,
+					 * an idle poll of stale hints must not */
+					if (lf_level_empty(&mlq->level[prio]))
+						lf_drop_stale(mlq, prio);
+					else
+						starved = 1;
+					continue;
+				}
+				struct pcb_t * proc = lf_level_pop(&mlq->level[prio]);
+				if (proc != NULL) {
+					if (prio == MAX_PRIO - 1)
+						CAS(&mlq->epoch, &epoch, epoch + 1);
+					return proc;
+				}
+				/* Stale hint: give the slot back */
+				__atomic_fetch_add(&mlq->slot[prio], 1, __ATOMIC_ACQ_REL);
+				lf_drop_stale(mlq, prio);
+			}
+		}
+		if (!starved)
+			return NULL;
+		/* Every ready level is out of slot: the round is over */
+		CAS(&mlq->epoch, &epoch, epoch + 1);
+	}
+	return NULL;
+}
+
+int lf_mlq_empty(struct lf_mlq * mlq) {
+	int word;
+	for (word = 0; word < (int)BITS_TO_LONGS(MAX_PRIO); word++)
+		if (LOAD(&mlq->ready_map[word]))
+			return 0;
+	return 1;
+}
+
@@ -1,10 +1,14 @@
 
 #include "loader.h"
+#include "cpu.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-
-static uint32_t avail_pid = 1;
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define OPT_CALC	"calc"
 #define OPT_ALLOC	"alloc"
@@ -13,6 +17,9 @@ static uint32_t avail_pid = 1;
 #define OPT_WRITE	"write"
 #ifdef MM_PAGING
 #define OPT_MALLOC	"malloc"
+#define OPT_MEMCPY	"memcpy"
+#define OPT_MEMSET	"memset"
+#define OPT_MEMCMP	"memcmp"
 #endif
 
 static enum ins_opcode_t get_opcode(char * opt) {
@@ -23,6 +30,12 @@ static enum ins_opcode_t get_opcode(char * opt) {
 #ifdef MM_PAGING
 	}else if (!strcmp(opt, OPT_MALLOC)) {
 		return MALLOC;
+	}else if (!strcmp(opt, OPT_MEMCPY)) {
+		return MEMCPY;
+	}else if (!strcmp(opt, OPT_MEMSET)) {
+		return MEMSET;
+	}else if (!strcmp(opt, OPT_MEMCMP)) {
+		return MEMCMP;
 #endif
 	}else if (!strcmp(opt, OPT_FREE)) {
 		return FREE;
@@ -36,41 +49,105 @@ static enum ins_opcode_t get_opcode(char * opt) {
 	}
 }
 
-struct pcb_t * load(const char * path) {
-	/* Create new PCB for the new process */
-	struct pcb_t * proc = (struct pcb_t * )malloc(sizeof(struct pcb_t));
-	proc->pid = avail_pid;
-	avail_pid++;
-	proc->page_table =
-		(struct page_table_t*)malloc(sizeof(struct page_table_t));
-	proc->bp = PAGE_SIZE;
-	proc->pc = 0;
+/* Program cache: every file loaded and still run by some process, its
+ * code shared read-only by all the processes loaded from it */
+struct program {
+	struct code_seg_t code;	// First, for release_code()
+	char * path;
+	uint32_t priority;
+	unsigned int refs;
+	struct program * next;
+};
+
+#define PROG_BUCKETS	256
+static struct program * programs[PROG_BUCKETS];
+static pthread_mutex_t prog_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A PCB and its page table, allocated and freed together */
+struct pcb_block {
+	struct pcb_t pcb;
+	struct page_table_t page_table;
+};
 
-	/* Read process code from file */
+/* Map the process image open as [fd] into [prog]. Return 1 if the file
+ * is not an image, which leaves [prog] untouched */
+static int load_image(const char * path, int fd, struct program * prog) {
+	struct code_seg_t * code = &prog->code;
+	struct image_hdr * hdr;
+	struct stat st;
+	void * map;
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(*hdr))
+		return 1;
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return 1;
+	hdr = (struct image_hdr*)map;
+	if (hdr->magic != IMAGE_MAGIC) {
+		munmap(map, st.st_size);
+		return 1;
+	}
+	if (hdr->version != IMAGE_VERSION || hdr->nr_opcodes != NR_OPCODES
+			|| hdr->inst_size != sizeof(struct inst_t)
+			|| st.st_size < (off_t)(sizeof(*hdr)
+				+ (size_t)hdr->size * sizeof(struct inst_t))) {
+		printf("Process image '%s' does not match this build\n", path);
+		exit(1);
+	}
+	prog->priority = hdr->priority;
+	code->size = hdr->size;
+	code->text = (struct inst_t*)(hdr + 1);
+	code->map = map;
+	code->map_len = st.st_size;
+	return 0;
+}
+
+/* Read the program at [path], an image or a process text */
+static struct program * read_program(const char * path) {
+	struct program * prog = calloc(1, sizeof(struct program));
+	struct code_seg_t * code = &prog->code;
+	prog->path = strdup(path);
+
+	/* Map the process image, or read process code from file */
 	FILE * file;
-	if ((file = fopen(path, "r")) == NULL) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
 		printf("Cannot find process description at '%s'\n", path);
 		exit(1);		
 	}
+	if (load_image(path, fd, prog) == 0) {
+		close(fd);
+		decode_code(code);
+		return prog;
+	}
+	if ((file = fdopen(fd, "r")) == NULL) {
+		printf("Cannot find process description at '%s'\n", path);
+		exit(1);
+	}
 	char opcode[10];
-	proc->code = (struct code_seg_t*)malloc(sizeof(struct code_seg_t));
-	fscanf(file, "%u %u", &proc->priority, &proc->code->size);
-	proc->code->text = (struct inst_t*)malloc(
-		sizeof(struct inst_t) * proc->code->size
+	if (fscanf(file, "%u %u", &prog->priority, &code->size) != 2) {
+		printf("'%s' is not a process description\n", path);
+		exit(1);
+	}
+	code->text = (struct inst_t*)calloc(
+		code->size, sizeof(struct inst_t)
 	);
 	uint32_t i = 0;
-	for (i = 0; i < proc->code->size; i++) {
-		fscanf(file, "%s", opcode);
-		proc->code->text[i].opcode = get_opcode(opcode);
-		switch(proc->code->text[i].opcode) {
+	for (i = 0; i < code->size; i++) {
+		if (fscanf(file, "%9s", opcode) != 1) {
+			printf("'%s' ends before its %u instructions\n",
+				path, code->size);
+			exit(1);
+		}
+		code->text[i].opcode = get_opcode(opcode);
+		switch(code->text[i].opcode) {
 		case CALC:
 			break;
 		case ALLOC:
 			fscanf(
 				file,
 				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+				&code->text[i].arg_0,
+				&code->text[i].arg_1
 			);
 			break;
 #ifdef MM_PAGING
@@ -78,37 +155,177 @@ struct pcb_t * load(const char * path) {
 			fscanf(
 				file,
 				"%u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1
+				&code->text[i].arg_0,
+				&code->text[i].arg_1
 			);
 #endif
 		case FREE:
-			fscanf(file, "%u\n", &proc->code->text[i].arg_0);
+			fscanf(file, "%u\n", &code->text[i].arg_0);
 			break;
 		case READ:
 			fscanf(
 				file,
 				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
 			);
 		case WRITE:
 			fscanf(
 				file,
 				"%u %u %u\n",
-				&proc->code->text[i].arg_0,
-				&proc->code->text[i].arg_1,
-				&proc->code->text[i].arg_2
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2
 			);
 			break;	
+#ifdef MM_PAGING
+		case MEMCPY:
+		case MEMCMP:
+			/* [region] [offset] [region] [offset] [size] */
+			fscanf(
+				file,
+				"%u %u %u %u %u\n",
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2,
+				&code->text[i].arg_3,
+				&code->text[i].arg_4
+			);
+			break;
+		case MEMSET:
+			/* [region] [offset] [value] [size] */
+			fscanf(
+				file,
+				"%u %u %u %u\n",
+				&code->text[i].arg_0,
+				&code->text[i].arg_1,
+				&code->text[i].arg_2,
+				&code->text[i].arg_3
+			);
+			break;
+#endif
 		default:
 			printf("Opcode: %s\n", opcode);
 			exit(1);
 		}
 	}
+	fclose(file);
+	decode_code(code);
+	return prog;
+}
+
+static void free_program(struct program * prog) {
+	if (prog->code.map != NULL)
+		munmap(prog->code.map, prog->code.map_len);
+	else
+		free(prog->code.text);
+	free(prog->code.ops);
+	free(prog->path);
+	free(prog);
+}
+
+/* FNV-1a */
+static unsigned int hash_path(const char * path) {
+	unsigned int h = 2166136261u;
+	while (*path != '\0')
+		h = (h ^ (unsigned char)*path++) * 16777619u;
+	return h % PROG_BUCKETS;
+}
+
+/* Cached program at [path], or NULL. Called with prog_lock held */
+static struct program * find_program(const char * path, unsigned int h) {
+	struct program * prog;
+	for (prog = programs[h]; prog != NULL; prog = prog->next)
+		if (!strcmp(prog->path, path))
+			return prog;
+	return NULL;
+}
+
+/* Program at [path] with one more reference, read on the first one.
+ * Reading happens outside the lock; if another thread cached the same
+ * program meanwhile, its copy wins */
+static struct program * get_program(const char * path) {
+	unsigned int h = hash_path(path);
+	struct program * prog, * fresh;
+	pthread_mutex_lock(&prog_lock);
+	prog = find_program(path, h);
+	if (prog != NULL) {
+		prog->refs++;
+		pthread_mutex_unlock(&prog_lock);
+		return prog;
+	}
+	pthread_mutex_unlock(&prog_lock);
+
+	fresh = read_program(path);
+	pthread_mutex_lock(&prog_lock);
+	prog = find_program(path, h);
+	if (prog == NULL) {
+		prog = fresh;
+		fresh = NULL;
+		prog->next = programs[h];
+		programs[h] = prog;
+	}
+	prog->refs++;
+	pthread_mutex_unlock(&prog_lock);
+	if (fresh != NULL)
+		free_program(fresh);
+	return prog;
+}
+
+void release_code(struct code_seg_t * code) {
+	struct program * prog = (struct program*)code;
+	struct program ** it;
+	pthread_mutex_lock(&prog_lock);
+	if (--prog->refs > 0) {
+		pthread_mutex_unlock(&prog_lock);
+		return;
+	}
+	for (it = &programs[hash_path(prog->path)]; *it != prog;
+			it = &(*it)->next)
+		;
+	*it = prog->next;
+	pthread_mutex_unlock(&prog_lock);
+	free_program(prog);
+}
+
+struct pcb_t * load(const char * path) {
+	/* Create new PCB for the new process */
+	struct pcb_block * blk = malloc(sizeof(struct pcb_block));
+	struct pcb_t * proc = &blk->pcb;
+	struct program * prog = get_program(path);
+	proc->pid = 0;	// Numbered by the caller
+	proc->page_table = &blk->page_table;
+	proc->bp = PAGE_SIZE;
+	proc->pc = 0;
+	proc->stall = 0;
+	proc->faults = 0;
+	proc->priority = prog->priority;
+	proc->code = &prog->code;
 	return proc;
 }
 
+int write_image(const char * path, uint32_t priority,
+		const struct code_seg_t * code) {
+	struct image_hdr hdr = {
+		.magic		= IMAGE_MAGIC,
+		.version	= IMAGE_VERSION,
+		.nr_opcodes	= NR_OPCODES,
+		.inst_size	= sizeof(struct inst_t),
+		.priority	= priority,
+		.size		= code->size,
+	};
+	FILE * file = fopen(path, "wb");
+	if (file == NULL)
+		return 1;
+	if (fwrite(&hdr, sizeof(hdr), 1, file) != 1
+			|| fwrite(code->text, sizeof(struct inst_t), code->size,
+				file) != code->size) {
+		fclose(file);
+		return 1;
+	}
+	return fclose(file) != 0;
+}
+
 
 
@@ -0,0 +1,239 @@
+
+#include "metrics.h"
+#include "samples.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct proc_stat {
+	uint32_t pid;
+	uint32_t prio;
+	uint64_t arrival;
+	uint64_t first_run;
+	uint64_t finish;
+	uint64_t wait;
+	uint32_t quanta;
+	uint32_t migrations;
+	uint64_t deadline;
+};
+
+struct cpu_stat {
+	uint64_t busy;
+	uint64_t idle;
+	uint64_t switches;
+};
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct proc_stat * procs;
+static size_t nr_procs, procs_cap;
+static struct cpu_stat * cpus;
+static int nr_cpus;
+
+/* Percentiles reported for every summary */
+static const double pcts[] = { 50, 90, 99, 100 };
+#define NR_PCTS ((int)(sizeof(pcts) / sizeof(pcts[0])))
+
+enum metric { M_WAIT, M_RESPONSE, M_TURNAROUND, M_QUANTA, NR_METRICS };
+static const char * metric_name[NR_METRICS] = {
+	"wait", "response", "turnaround", "quanta"
+};
+
+static uint64_t metric(struct proc_stat * p, enum metric m) {
+	switch (m) {
+	case M_WAIT:		return p->wait;
+	case M_RESPONSE:	return p->first_run - p->arrival;
+	case M_QUANTA:		return p->quanta;
+	default:		return p->finish - p->arrival;
+	}
+}
+
+void metrics_init(int num_cpus) {
+	nr_cpus = num_cpus;
+	cpus = calloc(num_cpus, sizeof(struct cpu_stat));
+}
+
+void metrics_proc_done(struct pcb_t * proc) {
+	struct proc_stat * p;
+	pthread_mutex_lock(&metrics_lock);
+	if (nr_procs == procs_cap) {
+		size_t cap = procs_cap ? procs_cap << 1 : 64;
+		p = realloc(procs, sizeof(struct proc_stat) * cap);
+		if (p == NULL) {
+			printf("Cannot grow process metrics to %zu entries\n",
+				cap);
+			exit(1);
+		}
+		procs = p;
+		procs_cap = cap;
+	}
+	p = &procs[nr_procs++];
+	p->pid = proc->pid;
+	p->prio = proc->prio;
+	p->arrival = proc->arrival;
+	p->first_run = proc->first_run;
+	p->finish = proc->finish;
+	p->wait = proc->wait;
+	p->quanta = proc->quanta;
+	p->migrations = proc->migrations;
+	p->deadline = proc->deadline;
+	pthread_mutex_unlock(&metrics_lock);
+}
+
+void metrics_cpu(int cpu, uint64_t busy, uint64_t idle, uint64_t switches) {
+	cpus[cpu].busy += busy;
+	cpus[cpu].idle += idle;
+	cpus[cpu].switches += switches;
+}
+
+static int cmp_prio(const void * a, const void * b) {
+	const struct proc_stat * x = a, * y = b;
+	if (x->prio != y->prio)
+		return (x->prio > y->prio) - (x->prio < y->prio);
+	return (x->pid > y->pid) - (x->pid < y->pid);
+}
+
+/* Percentiles of [m] over procs[from, to) into [out] */
+static void summarize(size_t from, size_t to, enum metric m,
+		uint64_t out[NR_PCTS]) {
+	struct samples_t s = { 0 };
+	size_t i;
+	int k;
+	for (i = from; i < to; i++)
+		samples_add(&s, metric(&procs[i], m));
+	for (k = 0; k < NR_PCTS; k++)
+		out[k] = samples_pct(&s, pcts[k]);
+	samples_free(&s);
+}
+
+/* Call [emit] for the summary of every metric over all processes
+ * (prio -1) and then over the processes of each priority */
+static void for_each_summary(FILE * f, void (*emit)(FILE *, const char *,
+		int, const uint64_t *, int)) {
+	uint64_t v[NR_PCTS];
+	size_t from, to;
+	int first = 1;
+	int m;
+	for (m = 0; m < NR_METRICS; m++) {
+		summarize(0, nr_procs, m, v);
+		emit(f, metric_name[m], -1, v, first);
+		first = 0;
+	}
+	for (from = 0; from < nr_procs; from = to) {
+		for (to = from; to < nr_procs
+				&& procs[to].prio == procs[from].prio; to++)
+			;
+		for (m = 0; m < NR_METRICS; m++) {
+			summarize(from, to, m, v);
+			emit(f, metric_name[m], procs[from].prio, v, 0);
+		}
+	}
+}
+
+static void csv_summary(FILE * f, const char * name, int prio,
+		const uint64_t * v, int first) {
+	int k;
+	if (first) {
+		fprintf(f, "metric,prio");
+		for (k = 0; k < NR_PCTS; k++)
+			fprintf(f, ",p%g", pcts[k]);
+		fprintf(f, "\n");
+	}
+	if (prio < 0)
+		fprintf(f, "%s,all", name);
+	else
+		fprintf(f, "%s,%d", name, prio);
+	for (k = 0; k < NR_PCTS; k++)
+		fprintf(f, ",%lu", v[k]);
+	fprintf(f, "\n");
+}
+
+/* Three tables separated by a blank line: processes, CPUs, summary */
+static void write_csv(FILE * f) {
+	size_t i;
+	int c;
+	fprintf(f, "pid,prio,arrival,first_run,finish,wait,response,"
+		"turnaround,quanta,migrations,deadline\n");
+	for (i = 0; i < nr_procs; i++) {
+		struct proc_stat * p = &procs[i];
+		fprintf(f, "%u,%u,%lu,%lu,%lu,%lu,%lu,%lu,%u,%u,%lu\n",
+			p->pid, p->prio, p->arrival, p->first_run, p->finish,
+			p->wait, metric(p, M_RESPONSE),
+			metric(p, M_TURNAROUND), p->quanta, p->migrations,
+			p->deadline);
+	}
+	fprintf(f, "\ncpu,busy,idle,utilization,switches\n");
+	for (c = 0; c < nr_cpus; c++) {
+		uint64_t total = cpus[c].busy + cpus[c].idle;
+		fprintf(f, "%d,%lu,%lu,%.4f,%lu\n", c, cpus[c].busy,
+			cpus[c].idle, total ? (double)cpus[c].busy / total : 0.0,
+			cpus[c].switches);
+	}
+	fprintf(f, "\n");
+	for_each_summary(f, csv_summary);
+}
+
+static void json_summary(FILE * f, const char * name, int prio,
+		const uint64_t * v, int first) {
+	int k;
+	fprintf(f, "%s\n    {\"metric\": \"%s\", \"prio\": ",
+		first ? "" : ",", name);
+	if (prio < 0)
+		fprintf(f, "\"all\"");
+	else
+		fprintf(f, "%d", prio);
+	for (k = 0; k < NR_PCTS; k++)
+		fprintf(f, ", \"p%g\": %lu", pcts[k], v[k]);
+	fprintf(f, "}");
+}
+
+static void write_json(FILE * f) {
+	size_t i;
+	int c;
+	fprintf(f, "{\n  \"processes\": [");
+	for (i = 0; i < nr_procs; i++) {
+		struct proc_stat * p = &procs[i];
+		fprintf(f, "%s\n    {\"pid\": %u, \"prio\": %u, \"arrival\": %lu,"
+			" \"first_run\": %lu, \"finish\": %lu, \"wait\": %lu,"
+			" \"response\": %lu, \"turnaround\": %lu,"
+			" \"quanta\": %u, \"migrations\": %u, \"deadline\": %lu}",
+			i ? "," : "", p->pid, p->prio, p->arrival, p->first_run,
+			p->finish, p->wait, metric(p, M_RESPONSE),
+			metric(p, M_TURNAROUND), p->quanta, p->migrations,
+			p->deadline);
+	}
+	fprintf(f, "\n  ],\n  \"cpus\": [");
+	for (c = 0; c < nr_cpus; c++) {
+		uint64_t total = cpus[c].busy + cpus[c].idle;
+		fprintf(f, "%s\n    {\"cpu\": %d, \"busy\": %lu, \"idle\": %lu,"
+			" \"utilization\": %.4f, \"switches\": %lu}",
+			c ? "," : "", c, cpus[c].busy, cpus[c].idle,
+			total ? (double)cpus[c].busy / total : 0.0,
+			cpus[c].switches);
+	}
+	fprintf(f, "\n  ],\n  \"summary\": [");
+	for_each_summary(f, json_summary);
+	fprintf(f, "\n  ]\n}\n");
+}
+
+int metrics_write(const char * path) {
+	size_t len = strlen(path);
+	FILE * f = fopen(path, "w");
+	if (f == NULL)
+		return 1;
+	qsort(procs, nr_procs, sizeof(struct proc_stat), cmp_prio);
+	if (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+		write_json(f);
+	else
+		write_csv(f);
+	return fclose(f) != 0;
+}
+
+void metrics_free(void) {
+	free(procs);
+	free(cpus);
+	procs = NULL;
+	cpus = NULL;
+	nr_procs = procs_cap = 0;
+}
+
@@ -0,0 +1,28 @@
+
+#include "loader.h"
+#include <stdio.h>
+
+/*
+ * Process image converter: compile a process text, like those in
+ * input/proc/, to an image that load() maps without parsing.
+ *
+ * Usage: mkimage [process text] [image]
+ */
+
+int main(int argc, char * argv[]) {
+	struct pcb_t * proc;
+	if (argc != 3) {
+		printf("Usage: mkimage [process text] [image]\n");
+		return 1;
+	}
+	proc = load(argv[1]);
+	if (proc->code->map != NULL) {
+		printf("'%s' is already an image\n", argv[1]);
+		return 1;
+	}
+	if (write_image(argv[2], proc->priority, proc->code)) {
+		printf("Cannot write image to %s\n", argv[2]);
+		return 1;
+	}
+	return 0;
+}
@@ -5,8 +5,14 @@
  */
 
 #include "mm.h"
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+/* Free and used frame lists of every device, CPUs take and give back
+ * frames concurrently */
+static pthread_mutex_t fp_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*
  *  MEMPHY_mv_csr - move MEMPHY cursor
@@ -106,6 +112,78 @@ int MEMPHY_write(struct memphy_struct * mp, int addr, BYTE data)
    return 0;
 }
 
+/*
+ *  MEMPHY_read_block - read [n] bytes from MEMPHY device at once
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @buf: obtained bytes
+ *  @n: number of bytes
+ */
+int MEMPHY_read_block(struct memphy_struct *mp, int addr, BYTE *buf, int n)
+{
+   int i;
+
+   if (mp == NULL || addr < 0 || n < 0 || addr + n > mp->maxsz)
+     return -1;
+
+   if (mp->rdmflg) {
+      memcpy(buf, mp->storage + addr, n);
+      return 0;
+   }
+   for (i = 0; i < n; i++) /* Sequential access device */
+      MEMPHY_seq_read(mp, addr + i, &buf[i]);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_write_block - write [n] bytes to MEMPHY device at once
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @buf: written bytes
+ *  @n: number of bytes
+ */
+int MEMPHY_write_block(struct memphy_struct *mp, int addr, const BYTE *buf, int n)
+{
+   int i;
+
+   if (mp == NULL || addr < 0 || n < 0 || addr + n > mp->maxsz)
+     return -1;
+
+   if (mp->rdmflg) {
+      memcpy(mp->storage + addr, buf, n);
+      return 0;
+   }
+   for (i = 0; i < n; i++) /* Sequential access device */
+      MEMPHY_seq_write(mp, addr + i, buf[i]);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_set_block - fill [n] bytes of MEMPHY device with [value]
+ *  @mp: memphy struct
+ *  @addr: address of the first byte
+ *  @value: written value
+ *  @n: number of bytes
+ */
+int MEMPHY_set_block(struct memphy_struct *mp, int addr, BYTE value, int n)
+{
+   int i;
+
+   if (mp == NULL || addr < 0 || n < 0 || addr + n > mp->maxsz)
+     return -1;
+
+   if (mp->rdmflg) {
+      memset(mp->storage + addr, value, n);
+      return 0;
+   }
+   for (i = 0; i < n; i++) /* Sequential access device */
+      MEMPHY_seq_write(mp, addr + i, value);
+
+   return 0;
+}
+
 /*
  *  MEMPHY_format-format MEMPHY device
  *  @mp: memphy struct
@@ -123,6 +201,7 @@ int MEMPHY_format(struct memphy_struct *mp, int pagesz)
     /* Init head of free framephy list */ 
     fst = malloc(sizeof(struct framephy_struct));
     fst->fpn = iter;
+    fst->fp_next = NULL;
     mp->free_fp_list = fst;
 
     /* We have list with first element, fill in the rest num-1 element member*/
@@ -140,13 +219,18 @@ int MEMPHY_format(struct memphy_struct *mp, int pagesz)
 
 int MEMPHY_get_freefp(struct memphy_struct *mp, int *retfpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
+   struct framephy_struct *fp;
 
-   if (fp == NULL)
+   pthread_mutex_lock(&fp_lock);
+   fp = mp->free_fp_list;
+   if (fp == NULL) {
+     pthread_mutex_unlock(&fp_lock);
      return -1;
+   }
 
    *retfpn = fp->fpn;
    mp->free_fp_list = fp->fp_next;
+   pthread_mutex_unlock(&fp_lock);
 
    /* MEMPHY is iteratively used up until its exhausted
     * No garbage collector acting then it not been released
@@ -177,7 +261,8 @@ int MEMPHY_dump(struct memphy_struct *mp)
       //   }
       //   printf("%02X ", (unsigned char)mp->storage[i]);
       if (mp->storage[i] != 0) {
-         printf("%d: 0x%08llx\t\t0x%08x\n", i, (uintptr_t)(mp->storage + i), mp->storage[i]);
+         /* The device address, the host one changes from run to run */
+         printf("%d: 0x%08x\t\t0x%08x\n", i, i, mp->storage[i]);
       }
    }
    printf("\n"); // Newline after the last line of the dump
@@ -188,13 +273,62 @@ int MEMPHY_dump(struct memphy_struct *mp)
 
 int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
 {
-   struct framephy_struct *fp = mp->free_fp_list;
    struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
 
    /* Create new node with value fpn */
    newnode->fpn = fpn;
-   newnode->fp_next = fp;
+   pthread_mutex_lock(&fp_lock);
+   newnode->fp_next = mp->free_fp_list;
    mp->free_fp_list = newnode;
+   pthread_mutex_unlock(&fp_lock);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_put_usedfp - record that frame [fpn] was taken by [owner]
+ *  @mp: memphy struct
+ *  @fpn: frame page number
+ *  @owner: mm the frame is mapped into
+ */
+int MEMPHY_put_usedfp(struct memphy_struct *mp, int fpn, struct mm_struct *owner)
+{
+   struct framephy_struct *newnode = malloc(sizeof(struct framephy_struct));
+
+   newnode->fpn = fpn;
+   newnode->owner = owner;
+   pthread_mutex_lock(&fp_lock);
+   newnode->fp_next = mp->used_fp_list;
+   mp->used_fp_list = newnode;
+   pthread_mutex_unlock(&fp_lock);
+
+   return 0;
+}
+
+/*
+ *  MEMPHY_put_ownedfp - give every frame taken by [owner] back to the
+ *  free list, once it is done with them
+ *  @mp: memphy struct
+ *  @owner: mm the frames were recorded for
+ */
+int MEMPHY_put_ownedfp(struct memphy_struct *mp, struct mm_struct *owner)
+{
+   struct framephy_struct **link, *fp;
+
+   pthread_mutex_lock(&fp_lock);
+   link = &mp->used_fp_list;
+   while ((fp = *link) != NULL) {
+      if (fp->owner != owner) {
+         link = &fp->fp_next;
+         continue;
+      }
+      /* Move the node itself over to the free list */
+      *link = fp->fp_next;
+      fp->owner = NULL;
+      fp->fp_next = mp->free_fp_list;
+      mp->free_fp_list = fp;
+   }
+   pthread_mutex_unlock(&fp_lock);
 
    return 0;
 }
@@ -205,8 +339,11 @@ int MEMPHY_put_freefp(struct memphy_struct *mp, int fpn)
  */
 int init_memphy(struct memphy_struct *mp, int max_size, int randomflg)
 {
-   mp->storage = (BYTE *)malloc(max_size*sizeof(BYTE));
+   /* Zeroed so that reading memory never written gives the same value
+    * on every run */
+   mp->storage = (BYTE *)calloc(max_size, sizeof(BYTE));
    mp->maxsz = max_size;
+   mp->used_fp_list = NULL;
 
    MEMPHY_format(mp,PAGING_PAGESZ);
 
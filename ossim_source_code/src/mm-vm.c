@@ -281,18 +281,16 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
         int tgtfpn = PAGING_PTE_SWP(pte);
 
         /* Find a victim page to evict from RAM */
-        find_victim_page(caller->mm, &vicpgn);
-        if (vicpgn == -1)
-            return -1;
+        if (find_victim_page(caller->mm, &vicpgn) != 0)
+            return -1; /* No page to evict, vicpgn left unset */
 
         vicpte = mm->pgd[vicpgn];
         vicfpn = PAGING_PTE_PGN(vicpte);
 
-        /* Get free frame in MEMSWP */
-        MEMPHY_get_freefp(caller->active_mswp, &swpfpn);
-
-        if (swpfpn == -1)
+        /* Get free frame in MEMSWP, swpfpn is left unset without one */
+        if (MEMPHY_get_freefp(caller->active_mswp, &swpfpn) != 0)
             return -1;
+        MEMPHY_put_usedfp(caller->active_mswp, swpfpn, caller->mm);
 
         /* Do swap frame from MEMRAM to MEMSWP and vice versa */
         /* Copy victim frame to swap */
@@ -307,6 +305,7 @@ int pg_getpage(struct mm_struct *mm, int pgn, int *fpn, struct pcb_t *caller)
         /* Update its online status of the target page */
         pte_set_fpn(&mm->pgd[pgn], tgtfpn);
         enlist_pgn_node(&caller->mm->fifo_pgn, pgn);
+        caller->faults++;
     }
     *fpn = PAGING_PTE_FPN(pte);
     return 0;
@@ -390,7 +389,7 @@ int pgread(
 		uint32_t offset, // Source address = [source] + [offset]
 		uint32_t destination) 
 {
-    BYTE data;
+    BYTE data = 0; /* Reported as is when the read fails */
     int val = __read(proc, source, offset, &data);
 
     destination = (uint32_t) data;
@@ -447,6 +446,195 @@ int pgwrite(
 }
 
 
+/*pg_block - bytes of region [rgid] from [offset] on, for block instructions
+ *@caller: caller
+ *@rgid: memory region ID (used to identify variable in symbole table)
+ *@offset: offset of the first byte in the region
+ *@size: number of bytes, all must be in the region
+ *@addr: virtual address of the first byte
+ */
+static int pg_block(struct pcb_t *caller, int rgid, uint32_t offset,
+                    uint32_t size, int *addr)
+{
+    struct vm_rg_struct *currg = get_symrg_byid(caller->mm, rgid);
+    unsigned long len;
+
+    if (currg == NULL || currg->rg_start == currg->rg_end)
+        return -1; /* Invalid memory identify */
+    if (get_vma_by_num(caller->mm, currg->vmaid) == NULL)
+        return -1;
+
+    len = currg->rg_end > currg->rg_start ? currg->rg_end - currg->rg_start
+                                          : currg->rg_start - currg->rg_end;
+    if ((unsigned long)offset + size > len)
+        return -1;
+
+    *addr = currg->rg_start + offset;
+    return 0;
+}
+
+/*pg_span - bring in the page of [addr] and get where it is in MEMRAM
+ *@caller: caller
+ *@addr: virtual address
+ *@size: bytes wanted from [addr] on
+ *@phyaddr: physical address of [addr]
+ *
+ * Return how many of the [size] bytes are in that page, -1 on failure
+ */
+static int pg_span(struct pcb_t *caller, int addr, uint32_t size, int *phyaddr)
+{
+    int off = PAGING_OFFST(addr);
+    int fpn;
+
+    /* Get the page to MEMRAM, swap from MEMSWAP if needed */
+    if (pg_getpage(caller->mm, PAGING_PGN(addr), &fpn, caller) != 0)
+        return -1; /* invalid page access */
+
+    *phyaddr = (fpn << PAGING_ADDR_FPN_LOBIT) + off;
+    return size < (uint32_t)(PAGING_PAGESZ - off) ? (int)size
+                                                  : PAGING_PAGESZ - off;
+}
+
+#ifdef IODUMP
+static void pg_block_dump(struct pcb_t *proc)
+{
+#ifdef PAGETBL_DUMP
+    print_pgtbl(proc, 0, -1); //print max TBL
+#endif
+    MEMPHY_dump(proc->mram);
+}
+#endif
+
+/*pgmemcpy - PAGING-based copy of [size] bytes between regions
+ *@proc: Process executing the instruction
+ *@dst, @dst_off: destination region and offset in it
+ *@src, @src_off: source region and offset in it
+ *@size: number of bytes
+ *
+ * Each page on either side is brought in once and moved in one go. The
+ * bytes go through a page sized buffer, since bringing in the
+ * destination page may swap out the source one
+ */
+int pgmemcpy(struct pcb_t *proc, uint32_t dst, uint32_t dst_off,
+             uint32_t src, uint32_t src_off, uint32_t size)
+{
+    BYTE buf[PAGING_PAGESZ];
+    int src_addr, dst_addr;
+    int val = 0;
+
+#ifdef IODUMP
+    printf("memcpy region=%d offset=%d <- region=%d offset=%d size=%d\n",
+           dst, dst_off, src, src_off, size);
+#endif
+    if (pg_block(proc, src, src_off, size, &src_addr) != 0 ||
+        pg_block(proc, dst, dst_off, size, &dst_addr) != 0)
+        val = -1;
+
+    while (val == 0 && size > 0) {
+        int src_phy, dst_phy;
+        int n = pg_span(proc, src_addr, size, &src_phy);
+
+        if (n < 0 || MEMPHY_read_block(proc->mram, src_phy, buf, n) != 0) {
+            val = -1;
+            break;
+        }
+        n = pg_span(proc, dst_addr, n, &dst_phy);
+        if (n < 0 || MEMPHY_write_block(proc->mram, dst_phy, buf, n) != 0) {
+            val = -1;
+            break;
+        }
+        src_addr += n;
+        dst_addr += n;
+        size -= n;
+    }
+#ifdef IODUMP
+    pg_block_dump(proc);
+#endif
+    return val;
+}
+
+/*pgmemset - PAGING-based fill of [size] bytes of a region
+ *@proc: Process executing the instruction
+ *@dst, @dst_off: region and offset in it
+ *@value: byte written
+ *@size: number of bytes
+ */
+int pgmemset(struct pcb_t *proc, uint32_t dst, uint32_t dst_off,
+             uint32_t value, uint32_t size)
+{
+    int dst_addr;
+    int val = 0;
+
+#ifdef IODUMP
+    printf("memset region=%d offset=%d value=%d size=%d\n",
+           dst, dst_off, (BYTE)value, size);
+#endif
+    if (pg_block(proc, dst, dst_off, size, &dst_addr) != 0)
+        val = -1;
+
+    while (val == 0 && size > 0) {
+        int dst_phy;
+        int n = pg_span(proc, dst_addr, size, &dst_phy);
+
+        if (n < 0 || MEMPHY_set_block(proc->mram, dst_phy, value, n) != 0) {
+            val = -1;
+            break;
+        }
+        dst_addr += n;
+        size -= n;
+    }
+#ifdef IODUMP
+    pg_block_dump(proc);
+#endif
+    return val;
+}
+
+/*pgmemcmp - PAGING-based comparison of [size] bytes of two regions
+ *@proc: Process executing the instruction
+ *@rg_a, @off_a: first region and offset in it
+ *@rg_b, @off_b: second region and offset in it
+ *@size: number of bytes
+ *
+ * The result, as of memcmp(), is only reported like pgread() does
+ */
+int pgmemcmp(struct pcb_t *proc, uint32_t rg_a, uint32_t off_a,
+             uint32_t rg_b, uint32_t off_b, uint32_t size)
+{
+    BYTE buf_a[PAGING_PAGESZ], buf_b[PAGING_PAGESZ];
+    int addr_a, addr_b;
+    int res = 0;
+    int val = 0;
+
+    if (pg_block(proc, rg_a, off_a, size, &addr_a) != 0 ||
+        pg_block(proc, rg_b, off_b, size, &addr_b) != 0)
+        val = -1;
+
+    while (val == 0 && res == 0 && size > 0) {
+        int phy_a, phy_b;
+        int n = pg_span(proc, addr_a, size, &phy_a);
+
+        if (n < 0 || MEMPHY_read_block(proc->mram, phy_a, buf_a, n) != 0) {
+            val = -1;
+            break;
+        }
+        n = pg_span(proc, addr_b, n, &phy_b);
+        if (n < 0 || MEMPHY_read_block(proc->mram, phy_b, buf_b, n) != 0) {
+            val = -1;
+            break;
+        }
+        res = memcmp(buf_a, buf_b, n);
+        addr_a += n;
+        addr_b += n;
+        size -= n;
+    }
+#ifdef IODUMP
+    printf("memcmp region=%d offset=%d region=%d offset=%d result=%d\n",
+           rg_a, off_a, rg_b, off_b, res < 0 ? -1 : res > 0);
+    pg_block_dump(proc);
+#endif
+    return val;
+}
+
 /*free_pcb_memphy - collect all memphy of pcb
  *@caller: caller
  *@vmaid: ID vm area to alloc memory region
@@ -215,14 +215,10 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
                 temp->fp_next = newfp_str;
             }
 
-            /* add fram into used frame list if we need we can use it,
-              maybe it is unused in this assignment 
+            /* add fram into used frame list, free_mm() gives it back
+              from there
             */
-            struct framephy_struct *new_used_ls = malloc(sizeof(struct framephy_struct));
-            new_used_ls->fpn = fpn;
-            new_used_ls->owner = mm;
-            new_used_ls->fp_next = caller->mram->used_fp_list;
-            caller->mram->used_fp_list = new_used_ls;
+            MEMPHY_put_usedfp(caller->mram, fpn, mm);
         }
         else { /* ERROR CODE of obtaining somes but not enough frames */
             if (MEMPHY_get_freefp(caller->active_mswp, &fpn) == 0) {
@@ -240,7 +236,11 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
 
                 if (find_victim_page(mm, &victim_page) < 0)
                 {
+                    /* Nothing of ours in RAM to make room with: the
+                     * frames are all held by other processes */
                     printf("can't find victim page\n");
+                    MEMPHY_put_freefp(caller->active_mswp, no_fpn_sw);
+                    return -3000;
                 }
                 /* change the pte of victim_page to swap */
                 /* find pte from victim page */
@@ -280,11 +280,7 @@ int alloc_pages_range(struct pcb_t *caller, int req_pgnum, struct framephy_struc
                     temp->fp_next = newfp_str;
                 }
                 /* add a new list */
-                struct framephy_struct *new_used_ls = malloc(sizeof(struct framephy_struct));
-                new_used_ls->fpn = fpn;
-                new_used_ls->owner = mm;
-                new_used_ls->fp_next = caller->active_mswp->used_fp_list;
-                caller->active_mswp->used_fp_list = new_used_ls;
+                MEMPHY_put_usedfp(caller->active_mswp, fpn, mm);
 
                 if (pte) {
                     free(pte);
@@ -381,7 +377,13 @@ int __swap_cp_page(struct memphy_struct *mpsrc, int srcfpn,
 int init_mm(struct mm_struct *mm, struct pcb_t *caller) {
     struct vm_area_struct *vma0 = malloc(sizeof(struct vm_area_struct));
     struct vm_area_struct *vma1 = malloc(sizeof(struct vm_area_struct));
-    mm->pgd = malloc(PAGING_MAX_PGN * sizeof(uint32_t));
+    /* No page is mapped yet: an entry left as the heap had it could
+     * look present and point to any frame */
+    mm->pgd = calloc(PAGING_MAX_PGN, sizeof(uint32_t));
+    /* No variable is allocated yet. Left as is, the table would hold
+     * whatever the heap had there and a trace would depend on it */
+    memset(mm->symrgtbl, 0, sizeof(mm->symrgtbl));
+    mm->fifo_pgn = NULL;
     /* By default the owner comes with at least one vma for DATA */
 
 #ifdef MM_PAGING_HEAP_GODOWN
@@ -437,6 +439,40 @@ int init_mm(struct mm_struct *mm, struct pcb_t *caller) {
     return 0;
 }
 
+/*
+ * Release what init_mm() and the mappings since took for the mm of
+ * [caller], once it finished. Its frames go back to RAM and swap as
+ * recorded in their used lists: the page table cannot tell, a page
+ * mapped in place of a victim carries the swap frame number
+ * @caller:     owner process
+ */
+void free_mm(struct pcb_t *caller) {
+    struct mm_struct *mm = caller->mm;
+    struct vm_area_struct *vma = mm->mmap, *next_vma;
+    struct pgn_t *pg = mm->fifo_pgn, *next_pg;
+    MEMPHY_put_ownedfp(caller->mram, mm);
+    MEMPHY_put_ownedfp(caller->active_mswp, mm);
+    while (vma != NULL) {
+        struct vm_rg_struct *rg = vma->vm_freerg_list, *next_rg;
+        while (rg != NULL) {
+            next_rg = rg->rg_next;
+            free(rg);
+            rg = next_rg;
+        }
+        next_vma = vma->vm_next;
+        free(vma);
+        vma = next_vma;
+    }
+    while (pg != NULL) {
+        next_pg = pg->pg_next;
+        free(pg);
+        pg = next_pg;
+    }
+    free(mm->pgd);
+    free(mm);
+    caller->mm = NULL;
+}
+
 
 
 struct vm_rg_struct* init_vm_rg(int rg_start, int rg_end, int vmaid)
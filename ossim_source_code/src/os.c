@@ -4,15 +4,40 @@
 #include "sched.h"
 #include "loader.h"
 #include "mm.h"
+#include "metrics.h"
 
 #include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 static int time_slot;
 static int num_cpus;
 static int done = 0;
+static int finished = 0;	// Processes run to completion
+static int bench = 0;		// Collect and print statistics at exit
+static int serial = 0;		// Run on the single-threaded engine
+static pthread_mutex_t stat_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct samples_t migrations;	// Of every finished process
+static const char * metrics_path;	// Scheduling metrics output, if any
+
+/* CPUs with nothing to run sleep out of the slot barrier until a process
+ * is queued, instead of ticking through every empty slot */
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct timer_id_t ** idle_cpus;	// Parked CPUs, a stack
+static int nr_idle;
+static unsigned long work_gen;	// Bumped whenever a process is queued
+
+/* CPU hot-plug schedule from the configure file: from slot [at] on,
+ * [cpus] CPUs are online */
+struct hotplug {
+	unsigned long at;
+	int cpus;
+};
+static struct hotplug * hotplug;
+static int nr_hotplug;
+static int max_cpus;		// Most CPUs online at once
 
 #ifdef MM_PAGING
 static int memramsz;
@@ -31,143 +56,657 @@ struct mmpaging_ld_args {
 };
 #endif
 
-static struct ld_args{
-	char ** path;
-	unsigned long * start_time;
+/* Paths of the processes read but not admitted yet, any length. They
+ * are released in about the order they were read, so the arena is a
+ * list of chunks freed from the front once none of their paths is live */
+#define PATH_CHUNK 4096
+struct path_chunk {
+	struct path_chunk * next;
+	size_t used, size;
+	int live;		// Paths handed out and not released yet
+	char data[];
+};
+static struct path_chunk * arena_head, * arena_tail;
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* One process line of the configure file */
+struct ld_entry {
+	char * path;		// In the arena, "input/proc/" included
+	struct path_chunk * chunk;
+	unsigned long start_time;
+	unsigned long deadline;	// Relative to arrival, 0 if none
 #ifdef MLQ_SCHED
-	unsigned long * prio;
+	unsigned long prio;	// PRIO_UNSET for the one of the program
 #endif
-} ld_processes;
+};
+#define PRIO_UNSET ((unsigned long)-1)
+
+/* Process lines are read as the loader gets to them, so memory does not
+ * grow with the number of arrivals. read_config() leaves [file] at the
+ * first one */
+static struct {
+	FILE * file;
+	char * line;
+	size_t size;
+} ld_config;
 int num_processes;
 
+/* What a CPU carries from one slot to the next, in either engine */
+struct cpu_state {
+	int id;
+	struct pcb_t * proc;
+	int time_left;
+	int offline;		// Asked to unplug
+	uint64_t online_since;
+	uint64_t busy;		// Slots spent running a process
+	uint64_t switches;	// Dispatches
+};
+
+/* One online period of a CPU thread, owned and freed by the thread */
 struct cpu_args {
 	struct timer_id_t * timer_id;
-	int id;
+	struct cpu_state cpu;
 };
 
+/* Threaded engine: the running instance of each CPU, NULL while it is
+ * offline, and how many CPU threads are alive. Both under [live_lock] */
+static struct cpu_args ** cpu_slot;
+static int nr_live;
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t live_cond = PTHREAD_COND_INITIALIZER;
+static int nr_online;		// Only touched by whoever applies hotplug[]
+
+/* Outcome of cpu_step() */
+enum { CPU_RAN, CPU_IDLE, CPU_STOPPED };
+
+
+/* Scheduler hook, a queued process wakes one parked CPU */
+static void wake_idle_cpu(void) {
+	pthread_mutex_lock(&idle_lock);
+	__atomic_store_n(&work_gen, work_gen + 1, __ATOMIC_RELEASE);
+	if (nr_idle > 0)
+		timer_unpark(idle_cpus[--nr_idle]);
+	pthread_mutex_unlock(&idle_lock);
+}
+
+/* Wake every parked CPU so it can see the loader is done and stop */
+static void wake_all_cpus(void) {
+	pthread_mutex_lock(&idle_lock);
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+	while (nr_idle > 0)
+		timer_unpark(idle_cpus[--nr_idle]);
+	pthread_mutex_unlock(&idle_lock);
+}
 
-static void * cpu_routine(void * args) {
-	struct timer_id_t * timer_id = ((struct cpu_args*)args)->timer_id;
-	int id = ((struct cpu_args*)args)->id;
-	/* Check for new process in ready queue */
-	int time_left = 0;
-	struct pcb_t * proc = NULL;
+/* An idle CPU can stop. With hot-plug an unplugged CPU may hand its
+ * process back at any time, so idle CPUs wait for every process */
+static int all_done(void) {
+	if (!__atomic_load_n(&done, __ATOMIC_ACQUIRE))
+		return 0;
+	return nr_hotplug == 0
+		|| __atomic_load_n(&finished, __ATOMIC_RELAXED) == num_processes;
+}
+
+/* Nothing to run in this slot. Park until work is queued, unless some
+ * was queued since [gen] was read, before the get_proc() that failed */
+static void idle_slot(struct cpu_args * args, unsigned long gen) {
+	pthread_mutex_lock(&idle_lock);
+	if (gen == work_gen && !all_done()
+			&& !__atomic_load_n(&args->cpu.offline, __ATOMIC_ACQUIRE)) {
+		timer_park(args->timer_id);
+		idle_cpus[nr_idle++] = args->timer_id;
+	}
+	pthread_mutex_unlock(&idle_lock);
+	next_slot(args->timer_id);
+}
+
+/* Slots [cpu] was online for, up to now, without running a process */
+static uint64_t cpu_idle(struct cpu_state * cpu) {
+	return current_time() - cpu->online_since - cpu->busy;
+}
+
+/* Do the job of [cpu] in the current time slot */
+static int cpu_step(struct cpu_state * cpu) {
+	int id = cpu->id;
+	struct pcb_t * proc = cpu->proc;
+	/* Check the status of current process */
+	if (proc == NULL) {
+		/* No process is running, the we load new process from
+	 	* ready queue */
+		proc = get_proc(id);
+	}else if (proc->pc == proc->code->size && proc->stall == 0) {
+		/* The porcess has finish it job */
+		printf("\tCPU %d: Processed %2d has finished\n",
+			id ,proc->pid);
+		if (__atomic_add_fetch(&finished, 1, __ATOMIC_RELAXED)
+				== num_processes && nr_hotplug > 0)
+			wake_all_cpus();	/* Let the idle CPUs stop */
+		if (bench) {
+			pthread_mutex_lock(&stat_lock);
+			samples_add(&migrations, proc->migrations);
+			pthread_mutex_unlock(&stat_lock);
+		}
+		if (metrics_path != NULL) {
+			proc->finish = current_time();
+			metrics_proc_done(proc);
+		}
+		sched_proc_done(proc, cpu->time_left);
+		release_code(proc->code);
+#ifdef MM_PAGING
+		free_mm(proc);
+#endif
+		free(proc);
+		proc = get_proc(id);
+		cpu->time_left = 0;
+	}else if (cpu->time_left == 0) {
+		/* The process has done its job in current time slot */
+		printf("\tCPU %d: Put process %2d to run queue\n",
+			id, proc->pid);
+		put_proc(proc, id);
+		proc = get_proc(id);
+	}
+	cpu->proc = proc;
+
+	/* Recheck process status after loading new process */
+	if (proc == NULL && all_done()) {
+		/* No process to run, exit */
+		printf("\tCPU %d stopped\n", id);
+		if (metrics_path != NULL)
+			metrics_cpu(id, cpu->busy, cpu_idle(cpu),
+				cpu->switches);
+		return CPU_STOPPED;
+	}else if (proc == NULL) {
+		/* There may be new processes to run in
+		 * next time slots, just skip current slot */
+		return CPU_IDLE;
+	}else if (cpu->time_left == 0) {
+		printf("\tCPU %d: Dispatched process %2d\n",
+			id, proc->pid);
+		cpu->time_left = sched_quantum(proc);
+		cpu->switches++;
+	}
+
+	/* Run current process */
+	run_slot(proc);
+	cpu->busy++;
+	cpu->time_left--;
+	return CPU_RAN;
+}
+
+/* [cpu] is unplugged, its process goes back to the ready queue. The
+ * scheduler is told apart, see cpu_unplug_request() */
+static void cpu_unplug(struct cpu_state * cpu) {
+	if (cpu->proc != NULL) {
+		printf("\tCPU %d: Put process %2d to run queue\n",
+			cpu->id, cpu->proc->pid);
+		put_proc(cpu->proc, cpu->id);
+		cpu->proc = NULL;
+	}
+	printf("\tCPU %d unplugged\n", cpu->id);
+	if (metrics_path != NULL)
+		metrics_cpu(cpu->id, cpu->busy, cpu_idle(cpu), cpu->switches);
+}
+
+static void * cpu_routine(void * arg) {
+	struct cpu_args * args = (struct cpu_args*)arg;
+	struct timer_id_t * timer_id = args->timer_id;
+	struct cpu_state * cpu = &args->cpu;
 	while (1) {
-		/* Check the status of current process */
-		if (proc == NULL) {
-			/* No process is running, the we load new process from
-		 	* ready queue */
-			proc = get_proc();
-			if (proc == NULL) {
-                next_slot(timer_id);
-                continue; /* First load failed. skip dummy load */
-            }
-		}else if (proc->pc == proc->code->size) {
-			/* The porcess has finish it job */
-			printf("\tCPU %d: Processed %2d has finished\n",
-				id ,proc->pid);
-			free(proc);
-			proc = get_proc();
-			time_left = 0;
-		}else if (time_left == 0) {
-			/* The process has done its job in current time slot */
-			printf("\tCPU %d: Put process %2d to run queue\n",
-				id, proc->pid);
-			put_proc(proc);
-			proc = get_proc();
+		unsigned long gen = __atomic_load_n(&work_gen, __ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&cpu->offline, __ATOMIC_ACQUIRE)) {
+			cpu_unplug(cpu);
+			break;
 		}
-		
-		/* Recheck process status after loading new process */
-		if (proc == NULL && done) {
-			/* No process to run, exit */
-			printf("\tCPU %d stopped\n", id);
+		int state = cpu_step(cpu);
+		if (state == CPU_STOPPED)
 			break;
-		}else if (proc == NULL) {
-			/* There may be new processes to run in
-			 * next time slots, just skip current slot */
-			next_slot(timer_id);
+		if (state == CPU_IDLE) {
+			idle_slot(args, gen);
 			continue;
-		}else if (time_left == 0) {
-			printf("\tCPU %d: Dispatched process %2d\n",
-				id, proc->pid);
-			time_left = time_slot;
 		}
-		
-		/* Run current process */
-		run(proc);
-		time_left--;
 		next_slot(timer_id);
-		printf("ngu\n");
 	}
 	detach_event(timer_id);
+	pthread_mutex_lock(&live_lock);
+	if (cpu_slot[cpu->id] == args)
+		cpu_slot[cpu->id] = NULL;
+	if (--nr_live == 0)
+		pthread_cond_signal(&live_cond);
+	pthread_mutex_unlock(&live_lock);
+	free(args);
 	pthread_exit(NULL);
 	return NULL;
 }
 
-static void * ld_routine(void * args) {
+/* Start a thread for CPU [id] */
+static void cpu_plug(int id) {
+	struct cpu_args * args = calloc(1, sizeof(struct cpu_args));
+	pthread_t thread;
+	args->cpu.id = id;
+	args->cpu.online_since = current_time();
+	args->timer_id = attach_event();
+	sched_cpu_online(id);
+	pthread_mutex_lock(&live_lock);
+	cpu_slot[id] = args;
+	nr_live++;
+	pthread_mutex_unlock(&live_lock);
+	pthread_create(&thread, NULL, cpu_routine, args);
+	pthread_detach(thread);
+}
+
+/* Ask the thread of CPU [id] to unplug, waking it if it is parked.
+ * The thread only sees it in a later slot, which may be the one [id]
+ * is plugged again in, so the scheduler is told here, in order with
+ * sched_cpu_online() */
+static void cpu_unplug_request(int id) {
+	struct cpu_args * args;
+	int i;
+	pthread_mutex_lock(&live_lock);
+	args = cpu_slot[id];
+	cpu_slot[id] = NULL;
+	if (args != NULL) {
+		__atomic_store_n(&args->cpu.offline, 1, __ATOMIC_RELEASE);
+		sched_cpu_offline(id);
+		pthread_mutex_lock(&idle_lock);
+		for (i = 0; i < nr_idle; i++) {
+			if (idle_cpus[i] == args->timer_id) {
+				idle_cpus[i] = idle_cpus[--nr_idle];
+				timer_unpark(args->timer_id);
+				break;
+			}
+		}
+		pthread_mutex_unlock(&idle_lock);
+	}
+	pthread_mutex_unlock(&live_lock);
+}
+
+/* Plug or unplug CPUs, highest id first, until [n] are online */
+static void set_online_cpus(int n) {
+	while (nr_online < n) {
+		printf("\tCPU %d plugged\n", nr_online);
+		cpu_plug(nr_online++);
+	}
+	while (nr_online > n)
+		cpu_unplug_request(--nr_online);
+}
+
+/* Device applying the hot-plug schedule, until the workload is over.
+ * Time does not wait for it alone: once every CPU stopped it is let go
+ * instead of fast-forwarding to its next event */
+static void * hotplug_routine(void * args) {
+	struct timer_id_t * timer_id = (struct timer_id_t*)args;
+	int i;
+	timer_set_background(timer_id);
+	for (i = 0; i < nr_hotplug; i++) {
+		if (next_slot_until(timer_id, hotplug[i].at))
+			break;
+		if (__atomic_load_n(&finished, __ATOMIC_RELAXED) == num_processes)
+			break;
+		set_online_cpus(hotplug[i].cpus);
+	}
+	detach_event(timer_id);
+	pthread_exit(NULL);
+	return NULL;
+}
+
+/* Copy [prefix] then [s] into the arena, from [chunk] */
+static char * arena_strdup(const char * prefix, const char * s,
+		struct path_chunk ** chunk) {
+	size_t plen = strlen(prefix), len = strlen(s), need = plen + len + 1;
+	struct path_chunk * c;
+	char * p;
+	pthread_mutex_lock(&arena_lock);
+	c = arena_tail;
+	if (c == NULL || c->size - c->used < need) {
+		size_t size = need > PATH_CHUNK ? need : PATH_CHUNK;
+		c = malloc(sizeof(struct path_chunk) + size);
+		c->next = NULL;
+		c->used = 0;
+		c->size = size;
+		c->live = 0;
+		if (arena_tail != NULL)
+			arena_tail->next = c;
+		else
+			arena_head = c;
+		arena_tail = c;
+	}
+	p = c->data + c->used;
+	c->used += need;
+	c->live++;
+	pthread_mutex_unlock(&arena_lock);
+	memcpy(p, prefix, plen);
+	memcpy(p + plen, s, len + 1);
+	*chunk = c;
+	return p;
+}
+
+static void arena_release(struct path_chunk * chunk) {
+	pthread_mutex_lock(&arena_lock);
+	chunk->live--;
+	while (arena_head != arena_tail && arena_head->live == 0) {
+		struct path_chunk * c = arena_head;
+		arena_head = c->next;
+		free(c);
+	}
+	/* Nothing live at all, fill the last chunk again from the start */
+	if (arena_head == arena_tail && arena_head->live == 0)
+		arena_head->used = 0;
+	pthread_mutex_unlock(&arena_lock);
+}
+
+/* Next line of [file] that is not blank, NULL at its end */
+static char * ld_next_line(FILE * file) {
+	while (getline(&ld_config.line, &ld_config.size, file) != -1) {
+		if (ld_config.line[strspn(ld_config.line, " \t\r\n")] != '\0')
+			return ld_config.line;
+	}
+	return NULL;
+}
+
+/* Parse a process line into [e], but its path, which is left in [line]
+ * as [name]. Return 1 if malformed.
+ *  [start time] [path] [priority] [deadline]
+ * Legacy files leave the priority out. A real-time process has its
+ * deadline, relative to its arrival */
+static int ld_parse(char * line, struct ld_entry * e, char ** name) {
+	size_t len;
+	int n;
+	if (sscanf(line, "%lu %n", &e->start_time, &n) != 1)
+		return 1;
+	*name = line + n;
+	len = strcspn(*name, " \t\r\n");
+	if (len == 0)
+		return 1;
+	e->deadline = 0;
+#ifdef MLQ_SCHED
+	e->prio = PRIO_UNSET;
+	sscanf(*name + len, "%lu %lu", &e->prio, &e->deadline);
+#endif
+	(*name)[len] = '\0';
+	return 0;
+}
+
+/* Read the next process line of the configure file into [e] */
+static void ld_read(struct ld_entry * e) {
+	char * line = ld_next_line(ld_config.file);
+	char * name;
+	/* read_config() went through them all already */
+	if (line == NULL || ld_parse(line, e, &name)) {
+		printf("Configure file changed while running\n");
+		exit(1);
+	}
+	e->path = arena_strdup("input/proc/", name, &e->chunk);
+}
+
+/* Load the [i]th process of the configure file, read as [e], and set up
+ * its memory, everything that does not depend on when it starts. [args]
+ * is what ld_routine() was started with */
+static struct pcb_t * ld_load(struct ld_entry * e, int i, void * args) {
+	struct pcb_t * proc = load(e->path);
+	/* Processes may be loaded out of order, number them as listed */
+	proc->pid = i + 1;
+#ifdef MLQ_SCHED
+	if (e->prio == PRIO_UNSET)
+		e->prio = proc->priority;
+	proc->prio = e->prio;
+#else
+	proc->prio = proc->priority;
+#endif
+	proc->deadline = 0;
 #ifdef MM_PAGING
 	struct memphy_struct* mram = ((struct mmpaging_ld_args *)args)->mram;
 	struct memphy_struct** mswp = ((struct mmpaging_ld_args *)args)->mswp;
 	struct memphy_struct* active_mswp = ((struct mmpaging_ld_args *)args)->active_mswp;
+	proc->mm = malloc(sizeof(struct mm_struct));
+#ifdef MM_PAGING_HEAP_GODOWN
+	proc->vmemsz = vmemsz;
+#endif
+	init_mm(proc->mm, proc);
+	proc->mram = mram;
+	proc->mswp = mswp;
+	proc->active_mswp = active_mswp;
+#endif
+	return proc;
+}
+
+/* The process read as [e] reached its start time, hand it to the
+ * scheduler */
+static void ld_admit(struct pcb_t * proc, struct ld_entry * e) {
+	// if(e->path == NULL) printf("cc1\n");
+	// printf("%s\n", e->path);
+	// if(proc == NULL) printf("cc2\n");
+	// printf("%d\n", proc->pid);
+	// printf("%ld\n", e->prio);
+	printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
+		e->path, proc->pid, e->prio);
+	if (e->deadline)
+		proc->deadline = current_time() + e->deadline;
+	add_proc(proc);
+	arena_release(e->chunk);
+}
+
+/* Every process is loaded */
+static void ld_finish(void) {
+	fclose(ld_config.file);
+	free(ld_config.line);
+	free(arena_head);	// Emptied by the last arena_release()
+	wake_all_cpus();
+}
+
+/* Loader pool: LD_WORKERS threads run ld_load() ahead of time into a
+ * ring of LD_STAGE processes, which ld_routine() takes in order as their
+ * start times come. A worker only takes process [i] once [i] -
+ * LD_STAGE was taken out, so the ring never holds more */
+static pthread_t * ld_workers;
+static struct pcb_t * stage[LD_STAGE];
+static struct ld_entry stage_entry[LD_STAGE];	// What each was loaded from
+static int stage_next;	// Next process a worker loads
+static int stage_head;	// Next process ld_routine() takes
+static pthread_mutex_t stage_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Held from taking a number to reading its line, so lines go to
+ * processes in order without file reads under [stage_lock] */
+static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stage_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t stage_room = PTHREAD_COND_INITIALIZER;
+
+static void * ld_worker(void * args) {
+	while (1) {
+		struct pcb_t * proc;
+		int i;
+		pthread_mutex_lock(&read_lock);
+		pthread_mutex_lock(&stage_lock);
+		while (stage_next < num_processes
+				&& stage_next >= stage_head + LD_STAGE)
+			pthread_cond_wait(&stage_room, &stage_lock);
+		if (stage_next == num_processes) {
+			pthread_mutex_unlock(&stage_lock);
+			pthread_mutex_unlock(&read_lock);
+			break;
+		}
+		i = stage_next++;
+		pthread_mutex_unlock(&stage_lock);
+		/* Slot [i] is ours until stage[] says it is loaded */
+		ld_read(&stage_entry[i % LD_STAGE]);
+		pthread_mutex_unlock(&read_lock);
+
+		proc = ld_load(&stage_entry[i % LD_STAGE], i, args);
+		pthread_mutex_lock(&stage_lock);
+		stage[i % LD_STAGE] = proc;
+		pthread_cond_broadcast(&stage_ready);
+		pthread_mutex_unlock(&stage_lock);
+	}
+	return NULL;
+}
+
+/* Take the next process out of the ring, waiting for it to be loaded,
+ * and copy out what it was loaded from before a worker reuses it */
+static struct pcb_t * stage_take(struct ld_entry * e) {
+	struct pcb_t * proc;
+	pthread_mutex_lock(&stage_lock);
+	while ((proc = stage[stage_head % LD_STAGE]) == NULL)
+		pthread_cond_wait(&stage_ready, &stage_lock);
+	stage[stage_head % LD_STAGE] = NULL;
+	*e = stage_entry[stage_head % LD_STAGE];
+	stage_head++;
+	pthread_cond_broadcast(&stage_room);
+	pthread_mutex_unlock(&stage_lock);
+	return proc;
+}
+
+static void * ld_routine(void * args) {
+#ifdef MM_PAGING
 	struct timer_id_t * timer_id = ((struct mmpaging_ld_args *)args)->timer_id;
 #else
 	struct timer_id_t * timer_id = (struct timer_id_t*)args;
 #endif
 	int i = 0;
+	ld_workers = malloc(sizeof(pthread_t) * LD_WORKERS);
+	for (i = 0; i < LD_WORKERS; i++)
+		pthread_create(&ld_workers[i], NULL, ld_worker, args);
+	i = 0;
 	printf("ld_routine\n");
 	while (i < num_processes) {
-		struct pcb_t * proc = load(ld_processes.path[i]);
-#ifdef MLQ_SCHED
-		proc->prio = ld_processes.prio[i];
-#endif
-		while (current_time() < ld_processes.start_time[i]) {
-			next_slot(timer_id);
-		}
-#ifdef MM_PAGING
-		proc->mm = malloc(sizeof(struct mm_struct));
-#ifdef MM_PAGING_HEAP_GODOWN
-		proc->vmemsz = vmemsz;
-		printf("ngu1\n");
-#endif
-		init_mm(proc->mm, proc);
-		proc->mram = mram;
-		proc->mswp = mswp;
-		proc->active_mswp = active_mswp;
-#endif
-		// if(ld_processes.path[i] == NULL) printf("cc1\n");
-		// printf("%s\n", ld_processes.path[i]);
-		// if(proc == NULL) printf("cc2\n");
-		// printf("%d\n", proc->pid);
-		// printf("%ld\n", ld_processes.prio[i]);
-		printf("\tLoaded a process at %s, PID: %d PRIO: %ld\n",
-			ld_processes.path[i], proc->pid, ld_processes.prio[i]);
-		add_proc(proc);
-		free(ld_processes.path[i]);
+		struct ld_entry e;
+		struct pcb_t * proc = stage_take(&e);
+		next_slot_until(timer_id, e.start_time);
+		ld_admit(proc, &e);
 		i++;
 		next_slot(timer_id);
 	}
-	free(ld_processes.path);
-	free(ld_processes.start_time);
-	done = 1;
+	for (i = 0; i < LD_WORKERS; i++)
+		pthread_join(ld_workers[i], NULL);
+	free(ld_workers);
+	ld_finish();
 	detach_event(timer_id);
 	pthread_exit(NULL);
 	return NULL;
 }
 
+/* Deterministic engine: the loader and then every CPU in turn do their
+ * job for the slot from this thread alone, with the same steps as
+ * ld_routine() and cpu_routine().
+ *
+ * This fixes the order within a slot: hot-plug events first, then the
+ * loader, then the CPUs by id. A process loaded in a slot can thus be
+ * dispatched in that same slot. The threaded engine gives no order at
+ * all: there the loader may come after the CPUs, so not only the lines
+ * of a slot but the schedule itself can differ from run to run. The
+ * traces in output/ come from this engine */
+static void run_serial(void * ld_args) {
+	struct pcb_t * next = NULL;	// Loaded, waiting for its start time
+	struct ld_entry next_entry;	// What [next] was loaded from
+	struct cpu_state * cpus = calloc(max_cpus, sizeof(struct cpu_state));
+	int * state = malloc(max_cpus * sizeof(int));
+	int running = 0;
+	int i = 0, c, ev = 0;
+	for (c = 0; c < max_cpus; c++) {
+		cpus[c].id = c;
+		state[c] = c < num_cpus ? CPU_IDLE : CPU_STOPPED;
+		if (c < num_cpus)
+			sched_cpu_online(c);
+	}
+	running = nr_online = num_cpus;
+	printf("ld_routine\n");
+	while (1) {
+		int busy = 0;
+		/* Hot-plug, as hotplug_routine() does */
+		for (; ev < nr_hotplug && hotplug[ev].at <= current_time(); ev++) {
+			if (finished == num_processes) {
+				ev = nr_hotplug;
+				break;
+			}
+			while (nr_online < hotplug[ev].cpus) {
+				c = nr_online++;
+				printf("\tCPU %d plugged\n", c);
+				memset(&cpus[c], 0, sizeof(struct cpu_state));
+				cpus[c].id = c;
+				cpus[c].online_since = current_time();
+				sched_cpu_online(c);
+				state[c] = CPU_IDLE;
+				running++;
+			}
+			while (nr_online > hotplug[ev].cpus) {
+				c = --nr_online;
+				if (state[c] != CPU_STOPPED) {
+					cpu_unplug(&cpus[c]);
+					sched_cpu_offline(c);
+					state[c] = CPU_STOPPED;
+					running--;
+				}
+			}
+		}
+		if (i < num_processes) {
+			if (next == NULL) {
+				ld_read(&next_entry);
+				next = ld_load(&next_entry, i, ld_args);
+			}
+			if (current_time() >= next_entry.start_time) {
+				ld_admit(next, &next_entry);
+				i++;
+				next = NULL;
+			}
+		} else if (!done) {
+			ld_finish();
+		}
+		for (c = 0; c < max_cpus; c++) {
+			if (state[c] == CPU_STOPPED)
+				continue;
+			state[c] = cpu_step(&cpus[c]);
+			if (state[c] == CPU_STOPPED)
+				running--;
+			else if (state[c] == CPU_RAN)
+				busy = 1;
+		}
+		if (running == 0 && (ev == nr_hotplug || finished == num_processes))
+			break;
+		/* Skip the slots nobody needs, like next_slot_until() */
+		uint64_t wake = 0;
+		if (!busy && next != NULL)
+			wake = next_entry.start_time;
+		if (!busy && ev < nr_hotplug && (wake == 0 || hotplug[ev].at < wake))
+			wake = hotplug[ev].at;
+		timer_advance(wake);
+	}
+	free(state);
+	free(cpus);
+}
+
+static int cmp_hotplug(const void * a, const void * b) {
+	const struct hotplug * x = a, * y = b;
+	return (x->at > y->at) - (x->at < y->at);
+}
+
 static void read_config(const char * path) {
 	FILE * file;
 	if ((file = fopen(path, "r")) == NULL) {
 		printf("Cannot find configure file at %s\n", path);
 		exit(1);
 	}
-	fscanf(file, "%d %d %d\n", &time_slot, &num_cpus, &num_processes);
+	/* The first line may name the scheduling policy after the counts,
+	 * then the per-level quanta (see sched_parse_quantum()):
+	 *  [time slice] [N = Number of CPU] [M = Number of Processes] [policy] [quanta]
+	 */
+	char line[256], policy[32], quanta[128];
+	int nfields = 0;
+	if (fgets(line, sizeof(line), file) != NULL)
+		nfields = sscanf(line, "%d %d %d %31s %127s", &time_slot,
+			&num_cpus, &num_processes, policy, quanta);
+	if (nfields < 3) {
+		printf("Malformed configure file at %s\n", path);
+		exit(1);
+	}
+	if (nfields >= 4 && sched_set_policy(policy)) {
+		printf("Unknown scheduler policy '%s'\n", policy);
+		exit(1);
+	}
+	sched_set_quantum(time_slot);
+	if (nfields == 5 && sched_parse_quantum(quanta)) {
+		printf("Malformed quanta '%s'\n", quanta);
+		exit(1);
+	}
 	printf("time_slot: %d, num_cpus: %d, num_processes: %d\n", time_slot, num_cpus, num_processes);
-	ld_processes.path = (char**)malloc(sizeof(char*) * num_processes);
-	ld_processes.start_time = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
 #ifdef MM_PAGING
 	int sit;
-#ifdef MM_FIXED_MEMSZ
 	/* We provide here a back compatible with legacy OS simulatiom config file
          * In which, it have no addition config line for Mema, keep only one line
 	 * for legacy info 
@@ -180,69 +719,172 @@ static void read_config(const char * path) {
 #ifdef MM_PAGING_HEAP_GODOWN
 	vmemsz = 0x300000;
 #endif
-#else
+#ifndef MM_FIXED_MEMSZ
 	/* Read input config of memory size: MEMRAM and upto 4 MEMSWP (mem swap)
 	 * Format: (size=0 result non-used memswap, must have RAM and at least 1 SWAP)
 	 *        MEM_RAM_SZ MEM_SWP0_SZ MEM_SWP1_SZ MEM_SWP2_SZ MEM_SWP3_SZ
+	 * A legacy file goes on with its processes instead, a line whose
+	 * second field is a path, and keeps the sizes above
 	*/
-	fscanf(file, "%d\n", &memramsz);
+	long mem_at = ftell(file);
+	char * mem = ld_next_line(file);
+	int n = 0;
+	if (mem != NULL)
+		sscanf(mem, "%*d %*d%n", &n);
+	if (n == 0) {
+		fseek(file, mem_at, SEEK_SET);
+		mem = "";
+	}
+	if (sscanf(mem, "%d%n", &memramsz, &n) == 1)
+		mem += n;
 	printf("memramsz: %d\n", memramsz);
 	for(sit = 0; sit < PAGING_MAX_MMSWP; sit++){
-		fscanf(file, "%d", &(memswpsz[sit]));
+		if (sscanf(mem, "%d%n", &memswpsz[sit], &n) == 1)
+			mem += n;
 		printf("memswpsz: %d\n", memswpsz[sit]);}
 #ifdef MM_PAGING_HEAP_GODOWN
-	fscanf(file, "%d", &vmemsz);
+	if (sscanf(mem, "%d%n", &vmemsz, &n) == 1)
+		mem += n;
 	printf("vmemsz: %d\n", vmemsz);
 #endif 
-
-	fscanf(file, "\n"); /* Final character */
 #endif
 #endif
 
-#ifdef MLQ_SCHED
-	ld_processes.prio = (unsigned long*)
-		malloc(sizeof(unsigned long) * num_processes);
-#endif
+	/* Then the processes, see ld_parse(). Only checked here, the loader
+	 * comes back to read them one at a time as it needs them */
+	long first = ftell(file);
 	int i;
 	for (i = 0; i < num_processes; i++) {
-		ld_processes.path[i] = (char*)malloc(sizeof(char) * 100);
-		ld_processes.path[i][0] = '\0';
-		strcat(ld_processes.path[i], "input/proc/");
-		char proc[100];
-#ifdef MLQ_SCHED
-		fscanf(file, "%lu %s %lu\n", &ld_processes.start_time[i], proc, &ld_processes.prio[i]);
-		printf("DEBUG: Process - Start time: %lu, Name: %s, Priority: %lu\n", ld_processes.start_time[i], proc, ld_processes.prio[i]);
-#else
-		fscanf(file, "%lu %s\n", &ld_processes.start_time[i], proc);
-#endif
-		strcat(ld_processes.path[i], proc);
+		struct ld_entry e;
+		char * line = ld_next_line(file);
+		char * name;
+		if (line == NULL || ld_parse(line, &e, &name)) {
+			printf("Malformed process %d in configure file at %s\n",
+				i + 1, path);
+			exit(1);
+		}
+	}
+	/* Then the CPU hot-plug schedule, any number of lines
+	 *  cpus [time slot] [number of CPUs online from then on]
+	 */
+	char line_cpus[64];
+	max_cpus = num_cpus;
+	while (fgets(line_cpus, sizeof(line_cpus), file) != NULL) {
+		struct hotplug ev;
+		if (sscanf(line_cpus, "cpus %lu %d", &ev.at, &ev.cpus) != 2)
+			continue;
+		if (ev.cpus < 1) {
+			printf("A hot-plug event needs at least one CPU\n");
+			exit(1);
+		}
+		hotplug = realloc(hotplug, sizeof(struct hotplug) * (nr_hotplug + 1));
+		hotplug[nr_hotplug++] = ev;
+		if (ev.cpus > max_cpus)
+			max_cpus = ev.cpus;
 	}
+	qsort(hotplug, nr_hotplug, sizeof(struct hotplug), cmp_hotplug);
+	fseek(file, first, SEEK_SET);
+	ld_config.file = file;
+}
+
+static void usage(void) {
+	printf("Usage: os [-b] [-d] [-a affinity bound] [-m metrics.csv|.json]"
+		" [-i cycles,op=cost...] [-q auto|level:slots,from-to:slots...]"
+		" [-s %s]"
+		" [path to configure file]\n", sched_policy_list());
+}
+
+/* One line summary for the benchmark target, on stderr so that it can
+ * be kept apart from the trace */
+static void report_bench(const char * config) {
+	struct samples_t lat = { 0 };
+	uint64_t slots = current_time();
+	uint64_t moves = 0;
+	size_t i;
+	sched_dispatch_latency(&lat);
+	for (i = 0; i < migrations.n; i++)
+		moves += migrations.v[i];
+	fprintf(stderr, "%-8s %-28s dispatch ns p50 %6lu p90 %6lu p99 %7lu"
+		" max %8lu | %3d done in %5lu slots, %.3f/slot"
+		" | migrations %4lu, per process p50 %2lu max %3lu\n",
+		sched_policy_name(), config,
+		samples_pct(&lat, 50), samples_pct(&lat, 90),
+		samples_pct(&lat, 99), samples_pct(&lat, 100),
+		finished, slots, slots ? (double)finished / slots : 0.0,
+		moves, samples_pct(&migrations, 50),
+		samples_pct(&migrations, 100));
+	samples_free(&lat);
+	samples_free(&migrations);
 }
 
 int main(int argc, char * argv[]) {
-	/* Read config */
-	if (argc != 2) {
-		printf("Usage: os [path to configure file]\n");
+	/* Read options and config, a policy given with -s overrides the
+	 * one named in the configure file */
+	const char * policy = NULL;
+	const char * quanta = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "a:bdi:m:q:s:")) != -1) {
+		switch (opt) {
+		case 'a':
+			sched_set_affinity(atoi(optarg));
+			break;
+		case 'b':
+			bench = 1;
+			break;
+		case 'd':
+			serial = 1;
+			break;
+		case 'i':
+			if (cpu_set_model(optarg)) {
+				printf("Malformed CPU model '%s'\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			metrics_path = optarg;
+			break;
+		case 'q':
+			quanta = optarg;
+			break;
+		case 's':
+			policy = optarg;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	if (optind != argc - 1) {
+		usage();
 		return 1;
 	}
-	char path[100];
-	path[0] = '\0';
-	strcat(path, "input/");
-	strcat(path, argv[1]);
+	char * path = malloc(strlen("input/") + strlen(argv[optind]) + 1);
+	sprintf(path, "input/%s", argv[optind]);
 	read_config(path);
+	free(path);
+	if (policy != NULL && sched_set_policy(policy)) {
+		printf("Unknown scheduler policy '%s'\n", policy);
+		return 1;
+	}
+	if (quanta != NULL && sched_parse_quantum(quanta)) {
+		printf("Malformed quanta '%s'\n", quanta);
+		return 1;
+	}
+	if (bench)
+		sched_enable_stats();
 
-	pthread_t * cpu = (pthread_t*)malloc(num_cpus * sizeof(pthread_t));
-	struct cpu_args * args =
-		(struct cpu_args*)malloc(sizeof(struct cpu_args) * num_cpus);
-	pthread_t ld;
+	pthread_t ld, hp;
 	
-	/* Init timer */
+	/* Init timer, the serial engine drives time without devices. CPUs
+	 * attach themselves when they are plugged */
 	int i;
-	for (i = 0; i < num_cpus; i++) {
-		args[i].timer_id = attach_event();
-		args[i].id = i;
+	struct timer_id_t * ld_event = NULL;
+	struct timer_id_t * hp_event = NULL;
+	if (!serial) {
+		ld_event = attach_event();
+		if (nr_hotplug > 0)
+			hp_event = attach_event();
 	}
-	struct timer_id_t * ld_event = attach_event();
 	start_timer();
 
 #ifdef MM_PAGING
@@ -274,27 +916,60 @@ int main(int argc, char * argv[]) {
 
 
 	/* Init scheduler */
-	init_scheduler();
+	init_scheduler(max_cpus);
+	for (i = num_cpus; i < max_cpus; i++)
+		sched_cpu_offline(i);
+	if (metrics_path != NULL)
+		metrics_init(max_cpus);
+	idle_cpus = malloc(max_cpus * sizeof(struct timer_id_t *));
 
-	/* Run CPU and loader */
 #ifdef MM_PAGING
-	pthread_create(&ld, NULL, ld_routine, (void*)mm_ld_args);
+	void * ld_args = mm_ld_args;
 #else
-	pthread_create(&ld, NULL, ld_routine, (void*)ld_event);
+	void * ld_args = ld_event;
 #endif
-	for (i = 0; i < num_cpus; i++) {
-		pthread_create(&cpu[i], NULL,
-			cpu_routine, (void*)&args[i]);
-	}
+	if (serial) {
+		run_serial(ld_args);
+	} else {
+		sched_set_notify(wake_idle_cpu);
 
-	/* Wait for CPU and loader finishing */
-	for (i = 0; i < num_cpus; i++) {
-		pthread_join(cpu[i], NULL);
+		/* Run CPU and loader */
+		cpu_slot = calloc(max_cpus, sizeof(struct cpu_args *));
+		for (i = 0; i < num_cpus; i++)
+			cpu_plug(i);
+		nr_online = num_cpus;
+		pthread_create(&ld, NULL, ld_routine, ld_args);
+		if (hp_event != NULL)
+			pthread_create(&hp, NULL, hotplug_routine, hp_event);
+
+		/* Wait for CPU and loader finishing. CPU threads are
+		 * detached as they come and go */
+		pthread_join(ld, NULL);
+		if (hp_event != NULL)
+			pthread_join(hp, NULL);
+		pthread_mutex_lock(&live_lock);
+		while (nr_live > 0)
+			pthread_cond_wait(&live_cond, &live_lock);
+		pthread_mutex_unlock(&live_lock);
+		free(cpu_slot);
 	}
-	pthread_join(ld, NULL);
 
 	/* Stop timer */
 	stop_timer();
+	unsigned int rt_jobs, rt_missed;
+	sched_deadline_stats(&rt_jobs, &rt_missed);
+	if (rt_jobs > 0)
+		printf("Deadlines missed: %u of %u\n", rt_missed, rt_jobs);
+	if (bench)
+		report_bench(argv[optind]);
+	finish_scheduler();
+	free(idle_cpus);
+	free(hotplug);
+	if (metrics_path != NULL) {
+		if (metrics_write(metrics_path))
+			printf("Cannot write metrics to %s\n", metrics_path);
+		metrics_free();
+	}
 
 	return 0;
 
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "queue.h"
 
 int empty(struct queue_t * q) {
@@ -7,75 +8,174 @@ int empty(struct queue_t * q) {
 	return (q->size == 0);
 }
 
+/* Double the ring of [q], unwrapping it so the oldest process is at 0 */
+static void grow_queue(struct queue_t * q) {
+        unsigned int cap = q->cap ? q->cap << 1 : QUEUE_INIT_SIZE;
+        struct pcb_t ** proc = malloc(sizeof(struct pcb_t *) * cap);
+        if (proc == NULL) {
+            printf("Cannot grow ready queue to %u entries\n", cap);
+            exit(1);
+        }
+        for (int idx = 0; idx < q->size; idx++)
+            proc[idx] = q->proc[(q->head + idx) & (q->cap - 1)];
+        free(q->proc);
+        q->proc = proc;
+        q->head = 0;
+        q->cap = cap;
+}
+
 void enqueue(struct queue_t * q, struct pcb_t * proc) {
-        /* TODO: put a new process to queue [q] */
-        // if(q->size == 0){
-        //         q->proc[0] = proc;
-        //         q->size++;
-        //         return ;
-        // }
-        // q->size++;
-        // q->proc[q->size-1] = proc;
-        if (q == NULL)  return;//Check for NULL Multilevel queue and the priority of process is invalid
-        if (q->size >= MAX_QUEUE_SIZE)  return;//Check if priority queue is full
-
-        int idx = q->size++;
-        for (;idx - 1 >= 0 && q->proc[idx - 1]->priority > proc->priority;
-                idx--)
-        q->proc[idx] = q->proc[idx - 1] ;//Add a new process at the end of the queue has the same priority value, then increase the size
-        q->proc[idx] = proc;
+        /* Put a new process at the tail of queue [q] */
+        if (q == NULL)  return;
+        if ((unsigned int)q->size == q->cap)
+            grow_queue(q);
+
+        q->proc[(q->head + q->size) & (q->cap - 1)] = proc;
+        q->size++;
 }
 
 struct pcb_t * dequeue(struct queue_t * q) {
-        /* TODO: return a pcb whose prioprity is the highest
-                * in the queue [q] and remember to remove it from q
-                * */
-        // struct pcb_t* proc = NULL;
-        // if(q->proc[0] != NULL){
-        //         proc = q->proc[0];
-        //         for(int i = 0; i < q->size - 1; i++){
-        //                 q->proc[i] = q->proc[i+1];
-        //         }
-        //         q->size --;
-        // }
-        // return proc;
-        if (q == NULL)          return NULL;
-        struct pcb_t * proc = NULL;
-#ifdef MLQ_SCHED
-        for (int level = 0; level < MAX_PRIO; level++) {
-            /*
-            If queue at that level is empty or it's out of slot, then move to next level immediately
-            Else take the first process and move the rest processes of queue to the front by one index
-            */
-            if (q[level].size == 0 || q[level].slot == 0)         continue;
-            
-            proc = q[level].proc[0];
-            q[level].slot--;
-
-            for (int idx = 1; idx < q[level].size; idx++) {
-                q[level].proc[idx - 1] = q[level].proc[idx];
-                if (idx == q[level].size - 1)
-                    q[level].proc[idx] = NULL;
-            }
+        /* Take the process at the head of queue [q] */
+        if (q == NULL || q->size == 0)  return NULL;
+        struct pcb_t * proc = q->proc[q->head];
+        q->proc[q->head] = NULL;
+        q->head = (q->head + 1) & (q->cap - 1);
+        q->size--;
+	return proc;
+}
+
+/* Remove the process [idx] places behind the head of [q], moving the
+ * ones in front of it back by one */
+static struct pcb_t * queue_take(struct queue_t * q, int idx) {
+        unsigned int mask = q->cap - 1;
+        struct pcb_t * proc = q->proc[(q->head + idx) & mask];
+        for (; idx > 0; idx--)
+            q->proc[(q->head + idx) & mask] = q->proc[(q->head + idx - 1) & mask];
+        q->proc[q->head] = NULL;
+        q->head = (q->head + 1) & mask;
+        q->size--;
+        return proc;
+}
 
-            q[level].size--;
+struct pcb_t * dequeue_affine(struct queue_t * q, int cpu, unsigned int bound) {
+        if (q == NULL || q->size == 0)  return NULL;
+        struct pcb_t * head = q->proc[q->head];
+        struct pcb_t * proc;
+        unsigned int idx;
 
-            if (level == MAX_PRIO - 1) {
-                for (int queue_level = 0; queue_level < MAX_PRIO; queue_level++)
-                    q[queue_level].slot = MAX_PRIO - queue_level;
+        if (head->last_cpu != cpu && head->skipped < bound) {
+            for (idx = 1; idx <= bound && idx < (unsigned int)q->size; idx++) {
+                proc = q->proc[(q->head + idx) & (q->cap - 1)];
+                if (proc->last_cpu == cpu) {
+                    head->skipped++;
+                    proc->skipped = 0;
+                    return queue_take(q, idx);
+                }
             }
-            break;
         }
-#else
-        if (q[0].size == 0)  return NULL;
-        proc = q[0].proc[0];
-        q[0].proc[0] = NULL;
+        head->skipped = 0;
+        return dequeue(q);
+}
 
-        for (int idx = 1; idx < q[0].size; idx++)
-            q[0].proc[idx - 1] = q[0].proc[idx];
+/* Slot left for level [prio] in the current round, refilled on the
+ * first touch after the round has changed */
+static int mlq_slot(struct mlq_t * mlq, int prio) {
+        struct queue_t * q = &mlq->level[prio];
+        if (q->epoch != mlq->epoch) {
+            q->epoch = mlq->epoch;
+            q->slot = MAX_PRIO - prio;
+        }
+        return q->slot;
+}
+
+/* Start a new round: every non-empty level becomes eligible again */
+static void mlq_new_round(struct mlq_t * mlq) {
+        mlq->epoch++;
+        memcpy(mlq->ready_map, mlq->busy_map, sizeof(mlq->ready_map));
+}
 
-        q[0].size--;
-#endif
+void mlq_init(struct mlq_t * mlq) {
+        int prio;
+        memset(mlq, 0, sizeof(struct mlq_t));
+        for (prio = 0; prio < MAX_PRIO; prio++)
+            mlq->level[prio].slot = MAX_PRIO - prio;
+}
+
+void mlq_destroy(struct mlq_t * mlq) {
+        int prio;
+        for (prio = 0; prio < MAX_PRIO; prio++) {
+            free(mlq->level[prio].proc);
+            mlq->level[prio].proc = NULL;
+            mlq->level[prio].cap = 0;
+            mlq->level[prio].size = 0;
+        }
+}
+
+void mlq_enqueue(struct mlq_t * mlq, struct pcb_t * proc) {
+        if (mlq == NULL || proc->prio >= MAX_PRIO)  return;
+        enqueue(&mlq->level[proc->prio], proc);
+        set_bit(proc->prio, mlq->busy_map);
+        if (mlq_slot(mlq, proc->prio) > 0)
+            set_bit(proc->prio, mlq->ready_map);
+}
+
+struct pcb_t * mlq_dequeue(struct mlq_t * mlq) {
+        return mlq_dequeue_affine(mlq, -1, 0);
+}
+
+struct pcb_t * mlq_dequeue_affine(struct mlq_t * mlq, int cpu, unsigned int bound) {
+        /*
+        Take the head of the highest priority level which is non-empty and
+        still has slot. When every non-empty level is out of slot the round
+        is over, so refill them all at once and look again.
+        */
+        if (mlq == NULL)        return NULL;
+        int level = find_first_bit(mlq->ready_map, MAX_PRIO);
+        if (level == MAX_PRIO) {
+            if (mlq_empty(mlq))    return NULL;
+            mlq_new_round(mlq);
+            level = find_first_bit(mlq->ready_map, MAX_PRIO);
+        }
+
+        struct queue_t * q = &mlq->level[level];
+        struct pcb_t * proc = dequeue_affine(q, cpu, bound);
+        mlq_slot(mlq, level);
+        q->slot--;
+
+        if (empty(q)) {
+            clear_bit(level, mlq->busy_map);
+            clear_bit(level, mlq->ready_map);
+        } else if (q->slot == 0) {
+            clear_bit(level, mlq->ready_map);
+        }
+
+        if (level == MAX_PRIO - 1)
+            mlq_new_round(mlq);
 	return proc;
 }
 
+int mlq_empty(struct mlq_t * mlq) {
+        return find_first_bit(mlq->busy_map, MAX_PRIO) == MAX_PRIO;
+}
+
+void mlq_requeue(struct mlq_t * mlq, void (*update)(struct pcb_t * proc)) {
+        struct queue_t all;
+        struct pcb_t * proc;
+        int level;
+
+        memset(&all, 0, sizeof(all));
+        for (level = find_first_bit(mlq->busy_map, MAX_PRIO);
+                        level < MAX_PRIO;
+                        level = find_first_bit(mlq->busy_map, MAX_PRIO)) {
+            while (!empty(&mlq->level[level]))
+                enqueue(&all, dequeue(&mlq->level[level]));
+            clear_bit(level, mlq->busy_map);
+            clear_bit(level, mlq->ready_map);
+        }
+        while ((proc = dequeue(&all)) != NULL) {
+            update(proc);
+            mlq_enqueue(mlq, proc);
+        }
+        free(all.proc);
+}
+
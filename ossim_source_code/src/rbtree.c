@@ -0,0 +1,223 @@
+#include "rbtree.h"
+
+static void rb_rotate_left(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->right;
+	x->right = y->left;
+	if (y->left)
+		y->left->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+	y->left = x;
+	x->parent = y;
+}
+
+static void rb_rotate_right(struct rb_root * root, struct rb_node * x) {
+	struct rb_node * y = x->left;
+	x->left = y->right;
+	if (y->right)
+		y->right->parent = x;
+	y->parent = x->parent;
+	if (x->parent == NULL)
+		root->node = y;
+	else if (x == x->parent->right)
+		x->parent->right = y;
+	else
+		x->parent->left = y;
+	y->right = x;
+	x->parent = y;
+}
+
+static int rb_is_black(struct rb_node * node) {
+	return node == NULL || node->color == RB_BLACK;
+}
+
+void rb_insert(struct rb_root * root, struct rb_node * node,
+		int (*less)(const struct rb_node *, const struct rb_node *)) {
+	struct rb_node ** link = &root->node, * parent = NULL;
+	int leftmost = 1;
+
+	while (*link) {
+		parent = *link;
+		if (less(node, parent)) {
+			link = &parent->left;
+		} else {
+			link = &parent->right;
+			leftmost = 0;
+		}
+	}
+	node->parent = parent;
+	node->left = node->right = NULL;
+	node->color = RB_RED;
+	*link = node;
+	if (leftmost)
+		root->leftmost = node;
+
+	/* Restore the colours: no red node may have a red parent */
+	while (node->parent && node->parent->color == RB_RED) {
+		struct rb_node * p = node->parent, * g = p->parent, * u;
+		if (p == g->left) {
+			u = g->right;
+			if (!rb_is_black(u)) {
+				p->color = u->color = RB_BLACK;
+				g->color = RB_RED;
+				node = g;
+				continue;
+			}
+			if (node == p->right) {
+				rb_rotate_left(root, p);
+				node = p;
+				p = node->parent;
+			}
+			p->color = RB_BLACK;
+			g->color = RB_RED;
+			rb_rotate_right(root, g);
+		} else {
+			u = g->left;
+			if (!rb_is_black(u)) {
+				p->color = u->color = RB_BLACK;
+				g->color = RB_RED;
+				node = g;
+				continue;
+			}
+			if (node == p->left) {
+				rb_rotate_right(root, p);
+				node = p;
+				p = node->parent;
+			}
+			p->color = RB_BLACK;
+			g->color = RB_RED;
+			rb_rotate_left(root, g);
+		}
+	}
+	root->node->color = RB_BLACK;
+}
+
+/* Put subtree [v] in place of [u] under the parent of [u] */
+static void rb_transplant(struct rb_root * root,
+		struct rb_node * u, struct rb_node * v) {
+	if (u->parent == NULL)
+		root->node = v;
+	else if (u == u->parent->left)
+		u->parent->left = v;
+	else
+		u->parent->right = v;
+	if (v)
+		v->parent = u->parent;
+}
+
+/* [x] (maybe NULL) under [parent] is short of one black node */
+static void rb_erase_fixup(struct rb_root * root,
+		struct rb_node * x, struct rb_node * parent) {
+	struct rb_node * w;
+	while (x != root->node && rb_is_black(x)) {
+		if (x == parent->left) {
+			w = parent->right;
+			if (w->color == RB_RED) {
+				w->color = RB_BLACK;
+				parent->color = RB_RED;
+				rb_rotate_left(root, parent);
+				w = parent->right;
+			}
+			if (rb_is_black(w->left) && rb_is_black(w->right)) {
+				w->color = RB_RED;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (rb_is_black(w->right)) {
+				w->left->color = RB_BLACK;
+				w->color = RB_RED;
+				rb_rotate_right(root, w);
+				w = parent->right;
+			}
+			w->color = parent->color;
+			parent->color = RB_BLACK;
+			w->right->color = RB_BLACK;
+			rb_rotate_left(root, parent);
+		} else {
+			w = parent->left;
+			if (w->color == RB_RED) {
+				w->color = RB_BLACK;
+				parent->color = RB_RED;
+				rb_rotate_right(root, parent);
+				w = parent->left;
+			}
+			if (rb_is_black(w->left) && rb_is_black(w->right)) {
+				w->color = RB_RED;
+				x = parent;
+				parent = x->parent;
+				continue;
+			}
+			if (rb_is_black(w->left)) {
+				w->right->color = RB_BLACK;
+				w->color = RB_RED;
+				rb_rotate_left(root, w);
+				w = parent->left;
+			}
+			w->color = parent->color;
+			parent->color = RB_BLACK;
+			w->left->color = RB_BLACK;
+			rb_rotate_right(root, parent);
+		}
+		x = root->node;
+	}
+	if (x)
+		x->color = RB_BLACK;
+}
+
+void rb_erase(struct rb_root * root, struct rb_node * node) {
+	struct rb_node * x, * parent;
+	int color = node->color;
+
+	if (root->leftmost == node)
+		root->leftmost = rb_next(node);
+
+	if (node->left == NULL) {
+		x = node->right;
+		parent = node->parent;
+		rb_transplant(root, node, x);
+	} else if (node->right == NULL) {
+		x = node->left;
+		parent = node->parent;
+		rb_transplant(root, node, x);
+	} else {
+		/* Replace [node] by its successor [y] */
+		struct rb_node * y = node->right;
+		while (y->left)
+			y = y->left;
+		color = y->color;
+		x = y->right;
+		if (y->parent == node) {
+			parent = y;
+		} else {
+			parent = y->parent;
+			rb_transplant(root, y, x);
+			y->right = node->right;
+			y->right->parent = y;
+		}
+		rb_transplant(root, node, y);
+		y->left = node->left;
+		y->left->parent = y;
+		y->color = node->color;
+	}
+	if (color == RB_BLACK)
+		rb_erase_fixup(root, x, parent);
+}
+
+struct rb_node * rb_next(struct rb_node * node) {
+	if (node->right) {
+		node = node->right;
+		while (node->left)
+			node = node->left;
+		return node;
+	}
+	while (node->parent && node == node->parent->right)
+		node = node->parent;
+	return node->parent;
+}
+
@@ -0,0 +1,54 @@
+#include "samples.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+void samples_add(struct samples_t * s, uint64_t value) {
+	if (s->n == s->cap) {
+		size_t cap = s->cap ? s->cap << 1 : 64;
+		uint64_t * v = realloc(s->v, sizeof(uint64_t) * cap);
+		if (v == NULL) {
+			printf("Cannot grow sample list to %zu entries\n", cap);
+			exit(1);
+		}
+		s->v = v;
+		s->cap = cap;
+	}
+	s->v[s->n++] = value;
+	s->sorted = 0;
+}
+
+void samples_merge(struct samples_t * dst, struct samples_t * src) {
+	size_t i;
+	for (i = 0; i < src->n; i++)
+		samples_add(dst, src->v[i]);
+}
+
+static int cmp_u64(const void * a, const void * b) {
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+uint64_t samples_pct(struct samples_t * s, double pct) {
+	size_t rank;
+	if (s->n == 0)
+		return 0;
+	if (!s->sorted) {
+		qsort(s->v, s->n, sizeof(uint64_t), cmp_u64);
+		s->sorted = 1;
+	}
+	rank = (size_t)(pct / 100.0 * s->n);
+	if (rank < pct / 100.0 * s->n)
+		rank++;
+	if (rank < 1)
+		rank = 1;
+	if (rank > s->n)
+		rank = s->n;
+	return s->v[rank - 1];
+}
+
+void samples_free(struct samples_t * s) {
+	free(s->v);
+	s->v = NULL;
+	s->n = s->cap = 0;
+}
+
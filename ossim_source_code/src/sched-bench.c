@@ -0,0 +1,110 @@
+#include "sched.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Ready queue contention benchmark. Every thread plays a CPU which
+ * repeatedly takes a process and puts it back, the way cpu_routine
+ * does at the end of each time slice, so all threads fight over the
+ * ready queue. Each policy is measured from 1 to [max threads].
+ *
+ * Usage: sched-bench [max threads] [operations per thread]
+ */
+
+#define BENCH_PROCS_PER_CPU 4
+
+static const char * policies[] = { "fifo", "mlq", "percpu", "lockfree", "cfs", "mlfq" };
+
+struct bench_args {
+	int id;
+	long ops;
+	long done;
+	pthread_barrier_t * start;
+};
+
+static void * bench_routine(void * args) {
+	struct bench_args * arg = (struct bench_args *)args;
+	long i;
+	pthread_barrier_wait(arg->start);
+	for (i = 0; i < arg->ops; i++) {
+		struct pcb_t * proc = get_proc(arg->id);
+		if (proc != NULL) {
+			put_proc(proc, arg->id);
+			arg->done++;
+		}
+	}
+	return NULL;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench(const char * policy, int nthreads, long ops) {
+	int nprocs = nthreads * BENCH_PROCS_PER_CPU;
+	struct pcb_t * procs = calloc(nprocs, sizeof(struct pcb_t));
+	pthread_t * threads = malloc(sizeof(pthread_t) * nthreads);
+	struct bench_args * args = calloc(nthreads, sizeof(struct bench_args));
+	pthread_barrier_t start;
+	long done = 0;
+	int i;
+
+	sched_set_policy(policy);
+	init_scheduler(nthreads);
+	for (i = 0; i < nprocs; i++) {
+		procs[i].pid = i + 1;
+		procs[i].prio = rand() % MAX_PRIO;
+		add_proc(&procs[i]);
+	}
+
+	pthread_barrier_init(&start, NULL, nthreads + 1);
+	for (i = 0; i < nthreads; i++) {
+		args[i].id = i;
+		args[i].ops = ops;
+		args[i].start = &start;
+		pthread_create(&threads[i], NULL, bench_routine, &args[i]);
+	}
+	double begin = now();
+	pthread_barrier_wait(&start);
+	for (i = 0; i < nthreads; i++) {
+		pthread_join(threads[i], NULL);
+		done += args[i].done;
+	}
+	double elapsed = now() - begin;
+
+	/* Drain so the next round starts from an empty queue, every
+	 * process must still be there */
+	int left = 0;
+	while (get_proc(0) != NULL)
+		left++;
+	if (left != nprocs)
+		printf("%s: %d of %d processes lost\n", policy, nprocs - left, nprocs);
+	finish_scheduler();
+	pthread_barrier_destroy(&start);
+
+	printf("%-8s %4d %14.0f %12.1f\n", policy, nthreads,
+		done / elapsed, elapsed * 1e9 / (ops * nthreads));
+	free(args);
+	free(threads);
+	free(procs);
+}
+
+int main(int argc, char * argv[]) {
+	int max_threads = argc > 1 ? atoi(argv[1]) : 128;
+	long ops = argc > 2 ? atol(argv[2]) : 100000;
+	unsigned int p;
+	int nthreads;
+
+	srand(0);
+	printf("%-8s %4s %14s %12s\n", "policy", "cpus", "dispatch/s", "ns/op");
+	for (p = 0; p < sizeof(policies) / sizeof(policies[0]); p++)
+		for (nthreads = 1; nthreads <= max_threads; nthreads <<= 1)
+			bench(policies[p], nthreads, ops);
+	return 0;
+}
+
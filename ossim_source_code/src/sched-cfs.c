@@ -0,0 +1,82 @@
+#include "sched.h"
+#include "timer.h"
+#include <pthread.h>
+
+/* Fair scheduler: runnable processes sorted by vruntime, which grows
+ * by the time slots used scaled down by the weight of the priority.
+ * Weights follow the MLQ share, a level gets MAX_PRIO - prio. */
+#define CFS_WEIGHT_SHIFT	16
+#define cfs_weight(prio)	(MAX_PRIO - (prio))
+static struct rb_root cfs_tree;
+static uint64_t cfs_min_vruntime;
+static pthread_mutex_t cfs_lock;
+
+static void init_cfs(int num_cpus) {
+	cfs_tree.node = cfs_tree.leftmost = NULL;
+	cfs_min_vruntime = 0;
+	pthread_mutex_init(&cfs_lock, NULL);
+}
+
+static void finish_cfs(void) {
+	pthread_mutex_destroy(&cfs_lock);
+}
+
+static int cfs_empty(void) {
+	return rb_first(&cfs_tree) == NULL;
+}
+
+/*
+ *  Fair scheduler: always run the process that has received the least
+ *  weighted CPU time so far. Dispatch is O(log n) whatever the number
+ *  of runnable processes and priorities.
+ */
+static int cfs_less(const struct rb_node * a, const struct rb_node * b) {
+	const struct pcb_t * pa = rb_entry(a, struct pcb_t, run_node);
+	const struct pcb_t * pb = rb_entry(b, struct pcb_t, run_node);
+	return pa->vruntime < pb->vruntime;
+}
+
+static struct pcb_t * get_cfs_proc(int cpu) {
+	struct pcb_t * proc = NULL;
+	pthread_mutex_lock(&cfs_lock);
+	struct rb_node * node = rb_first(&cfs_tree);
+	if (node != NULL) {
+		rb_erase(&cfs_tree, node);
+		proc = rb_entry(node, struct pcb_t, run_node);
+		if (proc->vruntime > cfs_min_vruntime)
+			cfs_min_vruntime = proc->vruntime;
+		proc->exec_start = current_time();
+	}
+	pthread_mutex_unlock(&cfs_lock);
+	return proc;
+}
+
+static void put_cfs_proc(struct pcb_t * proc, int cpu) {
+	uint64_t delta = current_time() - proc->exec_start;
+	if (delta == 0)
+		delta = 1;
+	pthread_mutex_lock(&cfs_lock);
+	proc->vruntime += (delta << CFS_WEIGHT_SHIFT) / cfs_weight(proc->prio);
+	rb_insert(&cfs_tree, &proc->run_node, cfs_less);
+	pthread_mutex_unlock(&cfs_lock);
+}
+
+static void add_cfs_proc(struct pcb_t * proc) {
+	if(proc->prio < 0 || proc->prio >= MAX_PRIO || proc->priority < 0) return;
+	pthread_mutex_lock(&cfs_lock);
+	/* Start level with the others instead of owing them all their past */
+	proc->vruntime = cfs_min_vruntime;
+	rb_insert(&cfs_tree, &proc->run_node, cfs_less);
+	pthread_mutex_unlock(&cfs_lock);
+}
+
+struct sched_policy cfs_policy = {
+	.name	= "cfs",
+	.init	= init_cfs,
+	.finish	= finish_cfs,
+	.empty	= cfs_empty,
+	.get	= get_cfs_proc,
+	.put	= put_cfs_proc,
+	.add	= add_cfs_proc,
+};
+
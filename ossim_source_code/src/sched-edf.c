@@ -0,0 +1,69 @@
+
+#include "heap.h"
+#include "sched.h"
+#include <pthread.h>
+
+/*
+ *  EDF real-time class: processes loaded with a deadline live in a heap
+ *  ordered by absolute deadline and are always picked before the ones
+ *  of the regular policy
+ */
+static struct heap_t edf_heap;
+static pthread_mutex_t edf_lock;
+static int edf_queued;	// Read without the lock by the fast path
+
+static int edf_less(struct pcb_t * a, struct pcb_t * b) {
+	if (a->deadline != b->deadline)
+		return a->deadline < b->deadline;
+	return a->pid < b->pid;
+}
+
+static void init_edf(int num_cpus) {
+	heap_init(&edf_heap, edf_less);
+	pthread_mutex_init(&edf_lock, NULL);
+	edf_queued = 0;
+}
+
+static void finish_edf(void) {
+	heap_destroy(&edf_heap);
+	pthread_mutex_destroy(&edf_lock);
+}
+
+static int edf_empty(void) {
+	return __atomic_load_n(&edf_queued, __ATOMIC_ACQUIRE) == 0;
+}
+
+static struct pcb_t * get_edf_proc(int cpu) {
+	struct pcb_t * proc;
+	/* No real-time process at all is the common case, skip the lock */
+	if (edf_empty())
+		return NULL;
+	pthread_mutex_lock(&edf_lock);
+	proc = heap_pop(&edf_heap);
+	if (proc != NULL)
+		__atomic_store_n(&edf_queued, edf_heap.size, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&edf_lock);
+	return proc;
+}
+
+static void add_edf_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&edf_lock);
+	heap_push(&edf_heap, proc);
+	__atomic_store_n(&edf_queued, edf_heap.size, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&edf_lock);
+}
+
+static void put_edf_proc(struct pcb_t * proc, int cpu) {
+	add_edf_proc(proc);
+}
+
+struct sched_policy edf_class = {
+	.name	= "edf",
+	.init	= init_edf,
+	.finish	= finish_edf,
+	.empty	= edf_empty,
+	.get	= get_edf_proc,
+	.put	= put_edf_proc,
+	.add	= add_edf_proc,
+};
+
@@ -0,0 +1,44 @@
+#include "lfqueue.h"
+#include "sched.h"
+
+/*
+ *  Lock-free MLQ: same policy as the global MLQ but CPUs and loader
+ *  never wait on a lock
+ */
+static struct lf_mlq lf_ready_queue;
+
+static void init_lf(int num_cpus) {
+	lf_mlq_init(&lf_ready_queue);
+}
+
+static void finish_lf(void) {
+	lf_mlq_destroy(&lf_ready_queue);
+}
+
+static int lf_empty(void) {
+	return lf_mlq_empty(&lf_ready_queue);
+}
+
+static struct pcb_t * get_lf_proc(int cpu) {
+	return lf_mlq_dequeue(&lf_ready_queue);
+}
+
+static void put_lf_proc(struct pcb_t * proc, int cpu) {
+	lf_mlq_enqueue(&lf_ready_queue, proc);
+}
+
+static void add_lf_proc(struct pcb_t * proc) {
+	if(proc->prio < 0 || proc->prio >= MAX_PRIO || proc->priority < 0) return;
+	lf_mlq_enqueue(&lf_ready_queue, proc);
+}
+
+struct sched_policy lockfree_policy = {
+	.name	= "lockfree",
+	.init	= init_lf,
+	.finish	= finish_lf,
+	.empty	= lf_empty,
+	.get	= get_lf_proc,
+	.put	= put_lf_proc,
+	.add	= add_lf_proc,
+};
+
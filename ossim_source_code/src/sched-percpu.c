@@ -0,0 +1,156 @@
+#include "queue.h"
+#include "sched.h"
+#include <pthread.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+
+/* Run queue owned by one CPU. [nr_queued] is only changed under [lock]
+ * and [busy] only by the owner, both atomically since peers read them
+ * without the lock as a load hint */
+struct cpu_rq {
+	struct mlq_t mlq;
+	pthread_mutex_t lock;
+	int nr_queued;
+	int busy;	// The owner CPU is running a process
+	int offline;	// Unplugged, gets no new process
+};
+static struct cpu_rq * cpu_rq;
+static int nr_cpus;
+
+static void init_percpu(int num_cpus) {
+	int cpu;
+	nr_cpus = num_cpus;
+	cpu_rq = malloc(sizeof(struct cpu_rq) * nr_cpus);
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		mlq_init(&cpu_rq[cpu].mlq);
+		pthread_mutex_init(&cpu_rq[cpu].lock, NULL);
+		cpu_rq[cpu].nr_queued = 0;
+		cpu_rq[cpu].busy = 0;
+		cpu_rq[cpu].offline = 0;
+	}
+}
+
+static void finish_percpu(void) {
+	int cpu;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		mlq_destroy(&cpu_rq[cpu].mlq);
+		pthread_mutex_destroy(&cpu_rq[cpu].lock);
+	}
+	free(cpu_rq);
+	cpu_rq = NULL;
+}
+
+static int percpu_empty(void) {
+	int cpu;
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		if (!mlq_empty(&cpu_rq[cpu].mlq))
+			return 0;
+	return 1;
+}
+
+/*
+ *  Per-CPU MLQ: a CPU only takes its own lock to pop and push back its
+ *  processes. When its queue is empty it steals from the most loaded
+ *  peer, and new processes are placed on the least loaded CPU.
+ */
+static void rq_enqueue(struct cpu_rq * rq, struct pcb_t * proc) {
+	pthread_mutex_lock(&rq->lock);
+	mlq_enqueue(&rq->mlq, proc);
+	__atomic_fetch_add(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&rq->lock);
+}
+
+static struct pcb_t * rq_dequeue(struct cpu_rq * rq) {
+	struct pcb_t * proc;
+	pthread_mutex_lock(&rq->lock);
+	proc = mlq_dequeue(&rq->mlq);
+	if (proc != NULL)
+		__atomic_fetch_sub(&rq->nr_queued, 1, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&rq->lock);
+	return proc;
+}
+
+static int rq_queued(struct cpu_rq * rq) {
+	return __atomic_load_n(&rq->nr_queued, __ATOMIC_RELAXED);
+}
+
+/* Queued processes plus the one running, used to place new processes */
+static int rq_load(struct cpu_rq * rq) {
+	return rq_queued(rq) + __atomic_load_n(&rq->busy, __ATOMIC_RELAXED);
+}
+
+static struct pcb_t * steal_percpu_proc(int cpu) {
+	int peer, victim = -1, max_queued = 0;
+	for (peer = 0; peer < nr_cpus; peer++) {
+		int queued = rq_queued(&cpu_rq[peer]);
+		if (peer != cpu && queued > max_queued) {
+			max_queued = queued;
+			victim = peer;
+		}
+	}
+	if (victim < 0)
+		return NULL;
+	return rq_dequeue(&cpu_rq[victim]);
+}
+
+static struct pcb_t * get_percpu_proc(int cpu) {
+	struct cpu_rq * rq = &cpu_rq[cpu];
+	struct pcb_t * proc = rq_dequeue(rq);
+	if (proc == NULL)
+		proc = steal_percpu_proc(cpu);
+	__atomic_store_n(&rq->busy, proc != NULL, __ATOMIC_RELAXED);
+	return proc;
+}
+
+/* Least loaded online CPU, CPU 0 if none is */
+static int percpu_target(void) {
+	int cpu, target = -1;
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		if (__atomic_load_n(&cpu_rq[cpu].offline, __ATOMIC_RELAXED))
+			continue;
+		if (target < 0 || rq_load(&cpu_rq[cpu]) < rq_load(&cpu_rq[target]))
+			target = cpu;
+	}
+	return target < 0 ? 0 : target;
+}
+
+/* An unplugged CPU can still put back its last process, place it */
+static void put_percpu_proc(struct pcb_t * proc, int cpu) {
+	__atomic_store_n(&cpu_rq[cpu].busy, 0, __ATOMIC_RELAXED);
+	if (__atomic_load_n(&cpu_rq[cpu].offline, __ATOMIC_RELAXED))
+		cpu = percpu_target();
+	rq_enqueue(&cpu_rq[cpu], proc);
+}
+
+static void add_percpu_proc(struct pcb_t * proc) {
+	if(proc->prio < 0 || proc->prio >= MAX_PRIO || proc->priority < 0) return;
+	rq_enqueue(&cpu_rq[percpu_target()], proc);
+}
+
+static void percpu_online(int cpu) {
+	__atomic_store_n(&cpu_rq[cpu].offline, 0, __ATOMIC_RELAXED);
+}
+
+/* Spread the queue of an unplugged CPU over the online ones. A process
+ * placed on it by a racing add is left for the others to steal */
+static void percpu_offline(int cpu) {
+	struct pcb_t * proc;
+	__atomic_store_n(&cpu_rq[cpu].offline, 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&cpu_rq[cpu].busy, 0, __ATOMIC_RELAXED);
+	while ((proc = rq_dequeue(&cpu_rq[cpu])) != NULL)
+		rq_enqueue(&cpu_rq[percpu_target()], proc);
+}
+
+struct sched_policy percpu_policy = {
+	.name	= "percpu",
+	.init	= init_percpu,
+	.finish	= finish_percpu,
+	.empty	= percpu_empty,
+	.get	= get_percpu_proc,
+	.put	= put_percpu_proc,
+	.add	= add_percpu_proc,
+	.cpu_online	= percpu_online,
+	.cpu_offline	= percpu_offline,
+};
+
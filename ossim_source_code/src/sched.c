@@ -1,58 +1,334 @@
-
 #include "queue.h"
 #include "sched.h"
+#include "timer.h"
 #include <pthread.h>
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static struct sched_policy * policies[] = {
+	&fifo_policy,
+	&mlq_policy,
+	&percpu_policy,
+	&lockfree_policy,
+	&cfs_policy,
+	&mlfq_policy,
+};
+#define NR_POLICIES ((int)(sizeof(policies) / sizeof(policies[0])))
+
+static struct sched_policy * policy = &mlq_policy;
+
+/* Told about every process made ready, see sched_set_notify() */
+static void (*notify_ready)(void) = NULL;
+
+/* Fairness bound of affine dispatch, see sched_set_affinity() */
+static unsigned int affinity_bound = 0;
+
+/* Slots per dispatch of each level, see sched_parse_quantum() */
+static unsigned int quantum[MAX_PRIO];
+static unsigned int quantum_max[MAX_PRIO];	// Growth limit in auto mode
+static int quantum_auto = 0;
+
+/* Finished processes with a deadline and misses among them */
+static unsigned int deadline_jobs, deadline_missed;
+
+/* Dispatch latency of each CPU, only kept when stats are enabled */
+static int stats_enabled = 0;
+static struct samples_t * dispatch_lat;
+static int nr_cpus;
+
+int sched_set_policy(const char * name) {
+	int i;
+	for (i = 0; i < NR_POLICIES; i++) {
+		if (!strcmp(name, policies[i]->name)) {
+			policy = policies[i];
+			return 0;
+		}
+	}
+	return 1;
+}
+
+const char * sched_policy_name(void) {
+	return policy->name;
+}
+
+const char * sched_policy_list(void) {
+	static char list[128];
+	int i;
+	if (list[0] == '\0') {
+		for (i = 0; i < NR_POLICIES; i++) {
+			if (i > 0)
+				strcat(list, "|");
+			strcat(list, policies[i]->name);
+		}
+	}
+	return list;
+}
+
+void sched_set_affinity(unsigned int bound) {
+	affinity_bound = bound;
+}
+
+void sched_set_quantum(unsigned int time_slot) {
+	int prio;
+	for (prio = 0; prio < MAX_PRIO; prio++) {
+		quantum[prio] = time_slot;
+		quantum_max[prio] = time_slot
+			+ time_slot * QUANTUM_SCALE * prio / (MAX_PRIO - 1);
+	}
+	quantum_auto = 0;
+}
+
+int sched_parse_quantum(const char * spec) {
+	unsigned int from, to, slots;
+	int len;
+	if (!strcmp(spec, "auto")) {
+		quantum_auto = 1;
+		return 0;
+	}
+	while (*spec != '\0') {
+		if (sscanf(spec, "%u-%u:%u%n", &from, &to, &slots, &len) != 3) {
+			if (sscanf(spec, "%u:%u%n", &from, &slots, &len) != 2)
+				return 1;
+			to = from;
+		}
+		if (from > to || to >= MAX_PRIO || slots == 0)
+			return 1;
+		for (; from <= to; from++)
+			quantum[from] = slots;
+		spec += len;
+		if (*spec == ',')
+			spec++;
+		else if (*spec != '\0')
+			return 1;
+	}
+	return 0;
+}
+
+unsigned int sched_quantum(struct pcb_t * proc) {
+	return __atomic_load_n(&quantum[proc->prio], __ATOMIC_RELAXED);
+}
+
+/* Racy read-modify-write, a lost update only delays the adaptation */
+void sched_proc_done(struct pcb_t * proc, unsigned int left) {
+	unsigned int q;
+	if (proc->deadline) {
+		__atomic_fetch_add(&deadline_jobs, 1, __ATOMIC_RELAXED);
+		if (current_time() > proc->deadline)
+			__atomic_fetch_add(&deadline_missed, 1,
+				__ATOMIC_RELAXED);
+	}
+	if (!quantum_auto || left == 0)
+		return;
+	q = __atomic_load_n(&quantum[proc->prio], __ATOMIC_RELAXED);
+	q = q > (left + 1) / 2 ? q - (left + 1) / 2 : 1;
+	__atomic_store_n(&quantum[proc->prio], q, __ATOMIC_RELAXED);
+}
+
+void sched_deadline_stats(unsigned int * jobs, unsigned int * missed) {
+	*jobs = __atomic_load_n(&deadline_jobs, __ATOMIC_RELAXED);
+	*missed = __atomic_load_n(&deadline_missed, __ATOMIC_RELAXED);
+}
+
+void sched_set_notify(void (*notify)(void)) {
+	notify_ready = notify;
+}
+
+void sched_enable_stats(void) {
+	stats_enabled = 1;
+}
+
+void sched_dispatch_latency(struct samples_t * out) {
+	int cpu;
+	for (cpu = 0; dispatch_lat != NULL && cpu < nr_cpus; cpu++)
+		samples_merge(out, &dispatch_lat[cpu]);
+}
+
+int queue_empty(void) {
+	return edf_class.empty() && policy->empty();
+}
+
+/* The class [proc] is queued in */
+static struct sched_policy * class_of(struct pcb_t * proc) {
+	return proc->deadline ? &edf_class : policy;
+}
+
+static struct pcb_t * pick_proc(int cpu) {
+	struct pcb_t * proc = edf_class.get(cpu);
+	return proc != NULL ? proc : policy->get(cpu);
+}
+
+void init_scheduler(int num_cpus) {
+	nr_cpus = num_cpus;
+	if (stats_enabled)
+		dispatch_lat = calloc(num_cpus, sizeof(struct samples_t));
+	policy->init(num_cpus);
+	edf_class.init(num_cpus);
+}
+
+void sched_cpu_online(int cpu) {
+	if (policy->cpu_online != NULL)
+		policy->cpu_online(cpu);
+}
+
+void sched_cpu_offline(int cpu) {
+	if (policy->cpu_offline != NULL)
+		policy->cpu_offline(cpu);
+}
+
+void finish_scheduler(void) {
+	int cpu;
+	policy->finish();
+	edf_class.finish();
+	for (cpu = 0; dispatch_lat != NULL && cpu < nr_cpus; cpu++)
+		samples_free(&dispatch_lat[cpu]);
+	free(dispatch_lat);
+	dispatch_lat = NULL;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct pcb_t * get_proc(int cpu) {
+	struct pcb_t * proc;
+	if (dispatch_lat == NULL) {
+		proc = pick_proc(cpu);
+	} else {
+		uint64_t start = now_ns();
+		proc = pick_proc(cpu);
+		samples_add(&dispatch_lat[cpu], now_ns() - start);
+	}
+	if (proc != NULL) {
+		uint64_t now = current_time();
+		if (proc->last_cpu >= 0 && proc->last_cpu != cpu)
+			proc->migrations++;
+		proc->last_cpu = cpu;
+		if (proc->first_run == UINT64_MAX)
+			proc->first_run = now;
+		proc->wait += now - proc->ready_since;
+		proc->quanta++;
+	}
+	return proc;
+}
+
+void put_proc(struct pcb_t * proc, int cpu) {
+	proc->ready_since = current_time();
+	if (quantum_auto) {
+		/* It used up its quantum, let its level run longer */
+		unsigned int q = __atomic_load_n(&quantum[proc->prio],
+			__ATOMIC_RELAXED);
+		if (q < quantum_max[proc->prio])
+			__atomic_store_n(&quantum[proc->prio], q + 1,
+				__ATOMIC_RELAXED);
+	}
+	class_of(proc)->put(proc, cpu);
+	if (notify_ready != NULL)
+		notify_ready();
+}
+
+void add_proc(struct pcb_t * proc) {
+	proc->last_cpu = -1;
+	proc->migrations = 0;
+	proc->skipped = 0;
+	proc->arrival = proc->ready_since = current_time();
+	proc->first_run = UINT64_MAX;
+	proc->wait = 0;
+	proc->quanta = 0;
+	class_of(proc)->add(proc);
+	if (notify_ready != NULL)
+		notify_ready();
+}
+
+/*
+ *  FIFO policy: round robin over a single queue. Processes put back
+ *  wait in [run_queue] until [ready_queue] has been drained.
+ */
 static struct queue_t ready_queue;
 static struct queue_t run_queue;
 static pthread_mutex_t queue_lock;
-int slot_cpu_can_use[MAX_PRIO];
-// int prioSlot[MAX_PRIO];
 
-int MarkedPrior = 0 ;
-int flag = 1;
-int count = 0;
+static void init_fifo(int num_cpus) {
+	memset(&ready_queue, 0, sizeof(ready_queue));
+	memset(&run_queue, 0, sizeof(run_queue));
+	pthread_mutex_init(&queue_lock, NULL);
+}
 
-#ifdef MLQ_SCHED
-static struct queue_t mlq_ready_queue[MAX_PRIO];
-#endif
+static void finish_fifo(void) {
+	free(ready_queue.proc);
+	free(run_queue.proc);
+	pthread_mutex_destroy(&queue_lock);
+}
 
-int queue_empty(void) {
-#ifdef MLQ_SCHED
-	unsigned long prio;
-	for (prio = 0; prio < MAX_PRIO; prio++)
-		if(!empty(&mlq_ready_queue[prio])) 
-			return -1;
-#endif
+static int fifo_empty(void) {
 	return (empty(&ready_queue) && empty(&run_queue));
 }
 
-void init_scheduler(void) {
-#ifdef MLQ_SCHED
-    int i ;
-
-	for (i = 0; i < MAX_PRIO; i++) {
-		mlq_ready_queue[i].size = 0;
-		// prioSlot[i] = MAX_PRIO - i;
-		// slot_cpu_can_use[i] = MAX_PRIO - i;
-		mlq_ready_queue[i].slot = MAX_PRIO - i;
+static struct pcb_t * get_fifo_proc(int cpu) {
+	struct pcb_t * proc = NULL;
+	pthread_mutex_lock(&queue_lock);
+	if (empty(&ready_queue)) {
+		struct queue_t tmp = ready_queue;
+		ready_queue = run_queue;
+		run_queue = tmp;
 	}
-#endif
-	ready_queue.size = 0;
-	run_queue.size = 0;
+	proc = dequeue_affine(&ready_queue, cpu, affinity_bound);
+	pthread_mutex_unlock(&queue_lock);
+	return proc;
+}
+
+static void put_fifo_proc(struct pcb_t * proc, int cpu) {
+	pthread_mutex_lock(&queue_lock);
+	enqueue(&run_queue, proc);
+	pthread_mutex_unlock(&queue_lock);
+}
+
+static void add_fifo_proc(struct pcb_t * proc) {
+	pthread_mutex_lock(&queue_lock);
+	enqueue(&ready_queue, proc);
+	pthread_mutex_unlock(&queue_lock);	
+}
+
+struct sched_policy fifo_policy = {
+	.name	= "fifo",
+	.init	= init_fifo,
+	.finish	= finish_fifo,
+	.empty	= fifo_empty,
+	.get	= get_fifo_proc,
+	.put	= put_fifo_proc,
+	.add	= add_fifo_proc,
+};
+
+/*
+ *  MLQ policy: a single multilevel queue shared by every CPU
+ */
+static struct mlq_t mlq_ready_queue;
+
+static void init_mlq(int num_cpus) {
+	mlq_init(&mlq_ready_queue);
 	pthread_mutex_init(&queue_lock, NULL);
 }
 
-#ifdef MLQ_SCHED
+static void finish_mlq(void) {
+	mlq_destroy(&mlq_ready_queue);
+	pthread_mutex_destroy(&queue_lock);
+}
+
+static int mlq_policy_empty(void) {
+	return mlq_empty(&mlq_ready_queue);
+}
+
 /* 
  *  Stateful design for routine calling
  *  based on the priority and our MLQ policy
  *  We implement stateful here using transition technique
  *  State representation   prio = 0 .. MAX_PRIO, curr_slot = 0..(MAX_PRIO - prio)
  */
-struct pcb_t * get_mlq_proc(void) {
+struct pcb_t * get_mlq_proc(int cpu) {
 	struct pcb_t * proc = NULL;
 	// /*TODO: get a process from PRIORITY [ready_queue].
 	//  * Remember to use lock to protect the queue.
@@ -101,58 +377,113 @@ struct pcb_t * get_mlq_proc(void) {
 	 * Remember to use lock to protect the queue.
 	 * */
 	pthread_mutex_lock(&queue_lock);
-    proc = dequeue(mlq_ready_queue);
+    proc = mlq_dequeue_affine(&mlq_ready_queue, cpu, affinity_bound);
     pthread_mutex_unlock(&queue_lock);
 	return proc;
 }
 
 void put_mlq_proc(struct pcb_t * proc) {
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	mlq_enqueue(&mlq_ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);
 }
 
 void add_mlq_proc(struct pcb_t * proc) {
 	if(proc->prio < 0 || proc->prio >= MAX_PRIO || proc->priority < 0) return;
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&mlq_ready_queue[proc->prio], proc);
+	mlq_enqueue(&mlq_ready_queue, proc);
 	pthread_mutex_unlock(&queue_lock);	
 }
 
-struct pcb_t * get_proc(void) {
-	return get_mlq_proc();
+static void put_mlq_cpu(struct pcb_t * proc, int cpu) {
+	put_mlq_proc(proc);
 }
 
-void put_proc(struct pcb_t * proc) {
-	return put_mlq_proc(proc);
+struct sched_policy mlq_policy = {
+	.name	= "mlq",
+	.init	= init_mlq,
+	.finish	= finish_mlq,
+	.empty	= mlq_policy_empty,
+	.get	= get_mlq_proc,
+	.put	= put_mlq_cpu,
+	.add	= add_mlq_proc,
+};
+
+/*
+ *  MLFQ policy: the MLQ above with moving priorities. A process is only
+ *  put back once it ran its full time_slot, so every put counts against
+ *  its allotment and sinks CPU-bound processes. Processes left waiting
+ *  are aged upward and periodic boosts restore the loaded priority, which
+ *  bounds how long a low priority process can starve.
+ */
+static uint64_t mlfq_last_scan;		// Slot of the last aging scan
+static uint64_t mlfq_last_boost;	// Slot of the last boost
+static int mlfq_boosting;		// mlfq_scan() is boosting, not aging
+
+static void init_mlfq(int num_cpus) {
+	init_mlq(num_cpus);
+	mlfq_last_scan = mlfq_last_boost = current_time();
 }
 
-void add_proc(struct pcb_t * proc) {
-	return add_mlq_proc(proc);
+static void mlfq_rise(struct pcb_t * proc) {
+	proc->allot = 0;
+	if (mlfq_boosting)
+		proc->prio = proc->base_prio;
+	else if (current_time() - proc->ready_since >= MLFQ_AGE)
+		proc->prio = proc->prio > MLFQ_STEP ? proc->prio - MLFQ_STEP : 0;
 }
-#else
-struct pcb_t * get_proc(void) {
-	struct pcb_t * proc = NULL;
-	/*TODO: get a process from [ready_queue].
-	 * Remember to use lock to protect the queue.
-	 * */
-	pthread_mutex_lock(&queue_lock);
-    proc = dequeue(&ready_queue);
-    pthread_mutex_unlock(&queue_lock);
-	return proc;
+
+/* Age or boost every waiting process, at most once per MLFQ_AGE slots.
+ * Called with queue_lock held */
+static void mlfq_scan(void) {
+	uint64_t now = current_time();
+	if (now - mlfq_last_scan < MLFQ_AGE)
+		return;
+	mlfq_last_scan = now;
+	mlfq_boosting = now - mlfq_last_boost >= MLFQ_BOOST;
+	if (mlfq_boosting)
+		__atomic_store_n(&mlfq_last_boost, now, __ATOMIC_RELAXED);
+	mlq_requeue(&mlq_ready_queue, mlfq_rise);
 }
 
-void put_proc(struct pcb_t * proc) {
+static struct pcb_t * get_mlfq_proc(int cpu) {
+	struct pcb_t * proc;
 	pthread_mutex_lock(&queue_lock);
-	enqueue(&run_queue, proc);
+	mlfq_scan();
+	proc = mlq_dequeue_affine(&mlq_ready_queue, cpu, affinity_bound);
 	pthread_mutex_unlock(&queue_lock);
+	if (proc != NULL)
+		proc->exec_start = current_time();
+	return proc;
 }
 
-void add_proc(struct pcb_t * proc) {
-	pthread_mutex_lock(&queue_lock);
-	enqueue(&ready_queue, proc);
-	pthread_mutex_unlock(&queue_lock);	
+static void put_mlfq_proc(struct pcb_t * proc, int cpu) {
+	if (proc->exec_start < __atomic_load_n(&mlfq_last_boost,
+			__ATOMIC_RELAXED)) {
+		/* A boost happened while it was running */
+		proc->prio = proc->base_prio;
+		proc->allot = 0;
+	} else if (++proc->allot >= MLFQ_ALLOT) {
+		proc->prio = proc->prio + MLFQ_STEP < MAX_PRIO ?
+			proc->prio + MLFQ_STEP : MAX_PRIO - 1;
+		proc->allot = 0;
+	}
+	put_mlq_proc(proc);
+}
+
+static void add_mlfq_proc(struct pcb_t * proc) {
+	proc->base_prio = proc->prio;
+	proc->allot = 0;
+	add_mlq_proc(proc);
 }
-#endif
 
+struct sched_policy mlfq_policy = {
+	.name	= "mlfq",
+	.init	= init_mlfq,
+	.finish	= finish_mlq,
+	.empty	= mlq_policy_empty,
+	.get	= get_mlfq_proc,
+	.put	= put_mlfq_proc,
+	.add	= add_mlfq_proc,
+};
 
@@ -1,9 +1,12 @@
-
 #include "timer.h"
 #include <stdio.h>
 #include <stdlib.h>
-
-static pthread_t _timer;
+#include <limits.h>
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
 
 struct timer_id_container_t {
 	struct timer_id_t id;
@@ -14,66 +17,132 @@ static struct timer_id_container_t * dev_list = NULL;
 
 static uint64_t _time;
 
-static int timer_started = 0;
-static int timer_stop = 0;
-
-
-static void * timer_routine(void * args) {
-	while (!timer_stop) {
-		printf("Time slot %3llu\n", current_time());
-		int fsh = 0;
-		int event = 0;
-		/* Wait for all devices have done the job in current
-		 * time slot */
-		struct timer_id_container_t * temp;
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.event_lock);
-			while (!temp->id.done && !temp->id.fsh) {
-				pthread_cond_wait(
-					&temp->id.event_cond,
-					&temp->id.event_lock
-				);
-			}
-			if (temp->id.fsh) {
-				fsh++;
-			}
-			event++;
-			pthread_mutex_unlock(&temp->id.event_lock);
-		}
 
-		/* Increase the time slot */
-		_time++;
-		/* Let devices continue their job */
-		for (temp = dev_list; temp != NULL; temp = temp->next) {
-			pthread_mutex_lock(&temp->id.timer_lock);
-			temp->id.done = 0;
-			pthread_cond_signal(&temp->id.timer_cond);
-			pthread_mutex_unlock(&temp->id.timer_lock);
-		}
-		if (fsh == event) {
-			break;
-		}
+/* Slot barrier. Devices arrive at the end of every slot and the last one
+ * to arrive moves time forward and releases the others by bumping [gen],
+ * so no thread of our own has to drive the clock. Everything but the
+ * waiting itself happens under [barrier_lock] */
+static pthread_mutex_t barrier_lock = PTHREAD_MUTEX_INITIALIZER;
+static int active;		// Devices time has to wait for
+static int arrived;		// Of those, arrived in the current slot
+static int bg_arrived;		// Of those, background devices
+static unsigned int bg_gen;	// Slot ended with only background devices
+static unsigned int gen;	// Bumped when a slot ends
+static uint64_t wake_at = UINT64_MAX;	// Earliest slot an arrived device needs
+#ifndef __linux__
+static pthread_cond_t barrier_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* End the current slot if every active device arrived. When none of
+ * them needs the next slot, skip straight to the earliest one needed.
+ * Called with barrier_lock held */
+static void try_advance(void) {
+	if (arrived == 0 || arrived < active)
+		return;
+	if (bg_arrived == arrived) {
+		/* Nobody needs time any more, let them go as it is */
+		bg_gen = gen + 1;
+	} else {
+		_time = wake_at > _time + 1 ? wake_at : _time + 1;
+		printf("Time slot %3lu\n", _time);
 	}
-	pthread_exit(args);
-	return args;
+	arrived = bg_arrived = 0;
+	wake_at = UINT64_MAX;
+	__atomic_store_n(&gen, gen + 1, __ATOMIC_RELEASE);
+#ifdef __linux__
+	syscall(SYS_futex, &gen, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	pthread_cond_broadcast(&barrier_cond);
+#endif
+}
+
+/* Drop barrier_lock and sleep until slot [g] is over */
+static void wait_slot(unsigned int g) {
+#ifdef __linux__
+	pthread_mutex_unlock(&barrier_lock);
+	while (__atomic_load_n(&gen, __ATOMIC_ACQUIRE) == g)
+		syscall(SYS_futex, &gen, FUTEX_WAIT_PRIVATE, g, NULL, NULL, 0);
+#else
+	while (gen == g)
+		pthread_cond_wait(&barrier_cond, &barrier_lock);
+	pthread_mutex_unlock(&barrier_lock);
+#endif
+}
+
+/* Arrive at the end of the current slot, needing time to go on at
+ * [slot] at the latest, and wait for the slot to end. Called with
+ * barrier_lock held, returns without it */
+static void arrive(struct timer_id_t * timer_id, uint64_t slot) {
+	unsigned int g = gen;
+	arrived++;
+	bg_arrived += timer_id->background;
+	if (slot < wake_at)
+		wake_at = slot;
+	try_advance();
+	if (gen == g)
+		wait_slot(g);
+	else
+		pthread_mutex_unlock(&barrier_lock);
 }
 
 void next_slot(struct timer_id_t * timer_id) {
-	/* Tell to timer that we have done our job in current slot */
-	pthread_mutex_lock(&timer_id->event_lock);
-	timer_id->done = 1;
-	pthread_cond_signal(&timer_id->event_cond);
-	pthread_mutex_unlock(&timer_id->event_lock);
-
-	/* Wait for going to next slot */
-	pthread_mutex_lock(&timer_id->timer_lock);
-	while (timer_id->done) {
-		pthread_cond_wait(
-			&timer_id->timer_cond,
-			&timer_id->timer_lock
-		);
+	pthread_mutex_lock(&barrier_lock);
+	if (timer_id->parked) {
+		/* Leave the barrier, time goes on without us */
+		timer_id->parked = 2;
+		active--;
+		try_advance();
+		while (timer_id->parked)
+			pthread_cond_wait(&timer_id->park_cond, &barrier_lock);
+		pthread_mutex_unlock(&barrier_lock);
+		return;
+	}
+	/* Tell that we have done our job in current slot and wait for
+	 * going to next slot */
+	arrive(timer_id, _time + 1);
+}
+
+int next_slot_until(struct timer_id_t * timer_id, uint64_t slot) {
+	pthread_mutex_lock(&barrier_lock);
+	while (_time < slot) {
+		unsigned int g = gen;
+		arrive(timer_id, slot);
+		pthread_mutex_lock(&barrier_lock);
+		if (bg_gen == g + 1 && timer_id->background) {
+			pthread_mutex_unlock(&barrier_lock);
+			return 1;
+		}
 	}
-	pthread_mutex_unlock(&timer_id->timer_lock);
+	pthread_mutex_unlock(&barrier_lock);
+	return 0;
+}
+
+void timer_set_background(struct timer_id_t * timer_id) {
+	pthread_mutex_lock(&barrier_lock);
+	timer_id->background = 1;
+	pthread_mutex_unlock(&barrier_lock);
+}
+
+void timer_advance(uint64_t slot) {
+	_time = slot > _time + 1 ? slot : _time + 1;
+	printf("Time slot %3lu\n", _time);
+}
+
+void timer_park(struct timer_id_t * timer_id) {
+	pthread_mutex_lock(&barrier_lock);
+	timer_id->parked = 1;
+	pthread_mutex_unlock(&barrier_lock);
+}
+
+void timer_unpark(struct timer_id_t * timer_id) {
+	pthread_mutex_lock(&barrier_lock);
+	if (timer_id->parked == 2) {
+		/* Asleep in next_slot(), rejoin the current slot */
+		active++;
+		pthread_cond_signal(&timer_id->park_cond);
+	}
+	timer_id->parked = 0;
+	pthread_mutex_unlock(&barrier_lock);
 }
 
 uint64_t current_time() {
@@ -81,52 +150,41 @@ uint64_t current_time() {
 }
 
 void start_timer() {
-	timer_started = 1;
-	pthread_create(&_timer, NULL, timer_routine, NULL);
+	printf("Time slot %3lu\n", _time);
 }
 
 void detach_event(struct timer_id_t * event) {
-	pthread_mutex_lock(&event->event_lock);
+	pthread_mutex_lock(&barrier_lock);
 	event->fsh = 1;
-	pthread_cond_signal(&event->event_cond);
-	pthread_mutex_unlock(&event->event_lock);
+	active--;
+	try_advance();
+	pthread_mutex_unlock(&barrier_lock);
 }
 
 struct timer_id_t * attach_event() {
-	if (timer_started) {
-		return NULL;
-	}else{
-		struct timer_id_container_t * container =
-			(struct timer_id_container_t*)malloc(
-				sizeof(struct timer_id_container_t)		
-			);
-		container->id.done = 0;
-		container->id.fsh = 0;
-		pthread_cond_init(&container->id.event_cond, NULL);
-		pthread_mutex_init(&container->id.event_lock, NULL);
-		pthread_cond_init(&container->id.timer_cond, NULL);
-		pthread_mutex_init(&container->id.timer_lock, NULL);
-		if (dev_list == NULL) {
-			dev_list = container;
-			dev_list->next = NULL;
-		}else{
-			container->next = dev_list;
-			dev_list = container;
-		}
-		return &(container->id);
-	}
+	struct timer_id_container_t * container =
+		(struct timer_id_container_t*)malloc(
+			sizeof(struct timer_id_container_t)
+		);
+	container->id.fsh = 0;
+	container->id.parked = 0;
+	container->id.background = 0;
+	pthread_cond_init(&container->id.park_cond, NULL);
+	/* Once the timer runs, the new device takes part from the
+	 * current slot on */
+	pthread_mutex_lock(&barrier_lock);
+	container->next = dev_list;
+	dev_list = container;
+	active++;
+	pthread_mutex_unlock(&barrier_lock);
+	return &(container->id);
 }
 
 void stop_timer() {
-	timer_stop = 1;
-	pthread_join(_timer, NULL);
 	while (dev_list != NULL) {
 		struct timer_id_container_t * temp = dev_list;
 		dev_list = dev_list->next;
-		pthread_cond_destroy(&temp->id.event_cond);
-		pthread_mutex_destroy(&temp->id.event_lock);
-		pthread_cond_destroy(&temp->id.timer_cond);
-		pthread_mutex_destroy(&temp->id.timer_lock);
+		pthread_cond_destroy(&temp->id.park_cond);
 		free(temp);
 	}
 }